@@ -0,0 +1,81 @@
+/**
+ * @file AABB.h
+ * @brief Axis aligned bounding box used by the broadphase.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <gfx/vec3.h>
+#include "Math.h"
+#include <algorithm>
+
+/**
+ * An axis aligned box in world space given by its min and max corners.
+ */
+struct AABB
+{
+    Vec3 lo;
+    Vec3 hi;
+
+    AABB() {}
+    AABB(const Vec3& i_lo, const Vec3& i_hi) : lo(i_lo), hi(i_hi) {}
+};
+
+/**
+ * returns true if the two boxes overlap or touch on all three axes
+ */
+inline bool overlaps(const AABB& a, const AABB& b)
+{
+    return a.lo[0] <= b.hi[0] && b.lo[0] <= a.hi[0] &&
+           a.lo[1] <= b.hi[1] && b.lo[1] <= a.hi[1] &&
+           a.lo[2] <= b.hi[2] && b.lo[2] <= a.hi[2];
+}
+
+/**
+ * returns the box containing both a and b
+ */
+inline AABB merge(const AABB& a, const AABB& b)
+{
+    AABB c;
+    for(int k = 0; k < 3; ++k){
+        c.lo[k] = std::min(a.lo[k], b.lo[k]);
+        c.hi[k] = std::max(a.hi[k], b.hi[k]);
+    }
+    return c;
+}
+
+/**
+ * returns the surface area of the box
+ */
+inline real_t area(const AABB& a)
+{
+    Vec3 d = a.hi - a.lo;
+    return 2.0*(d[0]*d[1] + d[1]*d[2] + d[2]*d[0]);
+}
+
+/**
+ * Slab test of the ray origin + t*dir for t in [0, max_t] against the box.
+ * inv_dir holds the reciprocals of the ray direction components.
+ * On a hit t_enter is set to the parameter where the ray enters the box.
+ */
+inline bool ray_intersects(const AABB& a, const Vec3& origin, const Vec3& inv_dir, real_t max_t, real_t& t_enter)
+{
+    real_t t_min = 0.0, t_max = max_t;
+    for(int k = 0; k < 3; ++k){
+        real_t t1 = (a.lo[k] - origin[k]) * inv_dir[k];
+        real_t t2 = (a.hi[k] - origin[k]) * inv_dir[k];
+        if(t1 > t2)
+            std::swap(t1, t2);
+        // NaNs from a zero direction with the origin on a slab face fail both tests and are ignored
+        if(t1 > t_min)
+            t_min = t1;
+        if(t2 < t_max)
+            t_max = t2;
+        if(t_min > t_max)
+            return false;
+    }
+    t_enter = t_min;
+    return true;
+}
@@ -0,0 +1,255 @@
+/**
+ * @file AABBTree.cpp
+ * @brief Bounding volume hierarchy over the bodies of a system.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "AABBTree.h"
+#include "Body.h"
+#include <algorithm>
+
+// rebuild once refitting has grown the internal nodes this much
+#define REBUILD_AREA_RATIO 2.0
+// the tree is split at the median so its depth is at most log2 of the body
+// count, and a depth first walk never holds more than one node per level
+#define MAX_STACK 128
+
+/**
+ * Orders bodies by their center along one axis.
+ **/
+struct CenterLess
+{
+    int axis;
+    CenterLess(int i_axis) : axis(i_axis) {}
+    bool operator()(const Body *a, const Body *b) const
+    {
+        return a->Position[axis] < b->Position[axis];
+    }
+};
+
+AABBTree::AABBTree() : num_proxies(0), build_area(0.0)
+{
+}
+
+AABBTree::~AABBTree()
+{
+    clear();
+}
+
+void AABBTree::clear()
+{
+    nodes.clear();
+    proxies.clear();
+    num_proxies = 0;
+    build_area = 0.0;
+}
+
+void AABBTree::update(const std::vector<Body*> &bodies, real_t dt)
+{
+    bool changed = (int) bodies.size() != num_proxies;
+    for(int i = 0; !changed && i < bodies.size(); ++i){
+        int id = bodies[i]->id;
+        changed = id < 0 || id >= proxies.size() || proxies[id] != bodies[i];
+    }
+
+    if(changed){
+        build_tree(bodies, dt);
+        return;
+    }
+
+    // children are stored after their parents, so walking backwards
+    // refits every child before the node that contains it
+    for(int i = (int) nodes.size() - 1; i >= 0; --i){
+        Node &n = nodes[i];
+        if(n.body)
+            get_fat_aabb(n.body, dt, n.box);
+        else
+            n.box = merge(nodes[n.left].box, nodes[n.right].box);
+    }
+
+    if(internal_area() > REBUILD_AREA_RATIO*build_area)
+        build_tree(bodies, dt);
+}
+
+void AABBTree::rebuild(const std::vector<Body*> &bodies)
+{
+    build_tree(bodies, 0.0);
+}
+
+void AABBTree::build_tree(const std::vector<Body*> &bodies, real_t dt)
+{
+    clear();
+    if(bodies.empty())
+        return;
+
+    int max_id = -1;
+    for(int i = 0; i < bodies.size(); ++i)
+        max_id = std::max(max_id, bodies[i]->id);
+    proxies.resize(max_id + 1, NULL);
+    for(int i = 0; i < bodies.size(); ++i)
+        proxies[bodies[i]->id] = bodies[i];
+    num_proxies = bodies.size();
+
+    build_list = bodies;
+    nodes.reserve(2*bodies.size() - 1);
+    build(0, build_list.size(), dt);
+    build_area = internal_area();
+}
+
+/**
+ * Recursively splits build_list[begin, end) at the median center along the
+ * axis where the centers are most spread out. Returns the new node's index.
+ **/
+int AABBTree::build(int begin, int end, real_t dt)
+{
+    int index = nodes.size();
+    nodes.push_back(Node());
+
+    if(end - begin == 1){
+        Node &leaf = nodes[index];
+        leaf.left = -1;
+        leaf.right = -1;
+        leaf.body = build_list[begin];
+        get_fat_aabb(leaf.body, dt, leaf.box);
+        return index;
+    }
+
+    Vec3 lo = build_list[begin]->Position;
+    Vec3 hi = lo;
+    for(int i = begin + 1; i < end; ++i){
+        const Vec3 &c = build_list[i]->Position;
+        for(int k = 0; k < 3; ++k){
+            lo[k] = std::min(lo[k], c[k]);
+            hi[k] = std::max(hi[k], c[k]);
+        }
+    }
+    Vec3 extent = hi - lo;
+    int axis = 0;
+    if(extent[1] > extent[axis])
+        axis = 1;
+    if(extent[2] > extent[axis])
+        axis = 2;
+
+    int mid = (begin + end) / 2;
+    std::nth_element(build_list.begin() + begin, build_list.begin() + mid,
+                     build_list.begin() + end, CenterLess(axis));
+
+    int left = build(begin, mid, dt);
+    int right = build(mid, end, dt);
+
+    // nodes may have been reallocated by the recursion
+    Node &n = nodes[index];
+    n.left = left;
+    n.right = right;
+    n.body = NULL;
+    n.box = merge(nodes[left].box, nodes[right].box);
+    return index;
+}
+
+real_t AABBTree::internal_area() const
+{
+    real_t total = 0.0;
+    for(int i = 0; i < nodes.size(); ++i){
+        if(!nodes[i].body)
+            total += area(nodes[i].box);
+    }
+    return total;
+}
+
+/**
+ * Descends the tree against itself. A pair of equal nodes stands for
+ * the pairs within that subtree.
+ **/
+void AABBTree::get_pairs(std::vector<BodyPair> &pairs)
+{
+    pairs.clear();
+    if(nodes.empty())
+        return;
+
+    pair_stack.clear();
+    pair_stack.push_back(std::make_pair(0, 0));
+    while(!pair_stack.empty()){
+        int a = pair_stack.back().first;
+        int b = pair_stack.back().second;
+        pair_stack.pop_back();
+
+        if(a == b){
+            if(is_leaf(a))
+                continue;
+            int l = nodes[a].left, r = nodes[a].right;
+            pair_stack.push_back(std::make_pair(l, l));
+            pair_stack.push_back(std::make_pair(r, r));
+            pair_stack.push_back(std::make_pair(l, r));
+            continue;
+        }
+
+        if(!overlaps(nodes[a].box, nodes[b].box))
+            continue;
+
+        if(is_leaf(a) && is_leaf(b)){
+            pairs.push_back(BodyPair(nodes[a].body, nodes[b].body));
+        }
+        else if(is_leaf(a) || (!is_leaf(b) && area(nodes[b].box) > area(nodes[a].box))){
+            // descend into the bigger node
+            pair_stack.push_back(std::make_pair(a, nodes[b].left));
+            pair_stack.push_back(std::make_pair(a, nodes[b].right));
+        }
+        else{
+            pair_stack.push_back(std::make_pair(nodes[a].left, b));
+            pair_stack.push_back(std::make_pair(nodes[a].right, b));
+        }
+    }
+}
+
+void AABBTree::query(const AABB &box, std::vector<Body*> &bodies) const
+{
+    if(nodes.empty())
+        return;
+
+    int stack[MAX_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0){
+        const Node &n = nodes[stack[--top]];
+        if(!overlaps(n.box, box))
+            continue;
+        if(n.body){
+            bodies.push_back(n.body);
+        }
+        else{
+            stack[top++] = n.left;
+            stack[top++] = n.right;
+        }
+    }
+}
+
+void AABBTree::ray_query(const Vec3 &origin, const Vec3 &dir, real_t max_t, std::vector<Body*> &bodies) const
+{
+    if(nodes.empty())
+        return;
+
+    Vec3 inv_dir(1.0/dir[0], 1.0/dir[1], 1.0/dir[2]);
+    std::vector<std::pair<real_t, Body*> > hits;
+    real_t t;
+
+    int stack[MAX_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0){
+        const Node &n = nodes[stack[--top]];
+        if(!ray_intersects(n.box, origin, inv_dir, max_t, t))
+            continue;
+        if(n.body){
+            hits.push_back(std::make_pair(t, n.body));
+        }
+        else{
+            stack[top++] = n.left;
+            stack[top++] = n.right;
+        }
+    }
+
+    std::sort(hits.begin(), hits.end());
+    for(int i = 0; i < hits.size(); ++i)
+        bodies.push_back(hits[i].second);
+}
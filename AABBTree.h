@@ -0,0 +1,72 @@
+/**
+ * @file AABBTree.h
+ * @brief Bounding volume hierarchy over the bodies of a system.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include "Broadphase.h"
+
+/**
+ * A binary tree of axis aligned boxes with one body per leaf.
+ *
+ * The tree is built top down once and then refit every update from the
+ * bodies' current Position, R and size, which keeps the update linear.
+ * Refitting lets the boxes of siblings grow apart as the bodies move,
+ * so the tree is rebuilt when the total area of its internal nodes has
+ * grown too far past the area it had when it was built.
+ *
+ * query() and ray_query() do not modify the tree and may be called from
+ * several threads at once.
+ */
+class AABBTree : public Broadphase
+{
+public:
+    AABBTree();
+    virtual ~AABBTree();
+
+    virtual void update(const std::vector<Body*> &bodies, real_t dt);
+    virtual void get_pairs(std::vector<BodyPair> &pairs);
+    virtual void query(const AABB &box, std::vector<Body*> &bodies) const;
+    virtual void clear();
+
+    /**
+     * Finds the bodies whose boxes are hit by the ray origin + t*dir for t in [0, max_t].
+     * @param bodies[out] The hit bodies are appended to this list, nearest box first.
+     */
+    void ray_query(const Vec3 &origin, const Vec3 &dir, real_t max_t, std::vector<Body*> &bodies) const;
+
+    /**
+     * Builds the tree from scratch over the given bodies.
+     */
+    void rebuild(const std::vector<Body*> &bodies);
+
+private:
+    struct Node
+    {
+        AABB box;
+        // children of an internal node, -1 for a leaf
+        int left;
+        int right;
+        // the body of a leaf, NULL for an internal node
+        Body *body;
+    };
+
+    void build_tree(const std::vector<Body*> &bodies, real_t dt);
+    int build(int begin, int end, real_t dt);
+    bool is_leaf(int node) const { return nodes[node].body != NULL; }
+    real_t internal_area() const;
+
+    // parents are always stored before their children
+    std::vector<Node> nodes;
+    // indexed by body id
+    std::vector<Body*> proxies;
+    int num_proxies;
+    real_t build_area;
+
+    // scratch space reused between calls
+    std::vector<Body*> build_list;
+    std::vector<std::pair<int, int> > pair_stack;
+};
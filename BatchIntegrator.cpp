@@ -0,0 +1,244 @@
+/**
+ * @file BatchIntegrator.cpp
+ * @brief Euler integration of many bodies at once from structure of arrays buffers.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "BatchIntegrator.h"
+#include <stdlib.h>
+#include <math.h>
+
+// The kernels are written once against these few operations, which map to
+// AVX, SSE2 or plain scalars depending on what the compiler targets and the
+// precision of real_t. The operations are done in the same order as the Vec3,
+// Quaternion and Matrix3 code they replace, so the results do not depend on
+// the vector width.
+#if defined(REAL_FLOAT) && defined(__AVX__)
+#include <immintrin.h>
+#define BATCH_LANES 8
+typedef __m256 vreal;
+static inline vreal vload(const real_t *p) { return _mm256_load_ps(p); }
+static inline void vstore(real_t *p, vreal a) { _mm256_store_ps(p, a); }
+static inline vreal vset1(real_t a) { return _mm256_set1_ps(a); }
+static inline vreal vadd(vreal a, vreal b) { return _mm256_add_ps(a, b); }
+static inline vreal vsub(vreal a, vreal b) { return _mm256_sub_ps(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm256_mul_ps(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm256_div_ps(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm256_sqrt_ps(a); }
+#elif defined(REAL_FLOAT) && defined(__SSE2__)
+#include <emmintrin.h>
+#define BATCH_LANES 4
+typedef __m128 vreal;
+static inline vreal vload(const real_t *p) { return _mm_load_ps(p); }
+static inline void vstore(real_t *p, vreal a) { _mm_store_ps(p, a); }
+static inline vreal vset1(real_t a) { return _mm_set1_ps(a); }
+static inline vreal vadd(vreal a, vreal b) { return _mm_add_ps(a, b); }
+static inline vreal vsub(vreal a, vreal b) { return _mm_sub_ps(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm_mul_ps(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm_div_ps(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm_sqrt_ps(a); }
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define BATCH_LANES 4
+typedef __m256d vreal;
+static inline vreal vload(const real_t *p) { return _mm256_load_pd(p); }
+static inline void vstore(real_t *p, vreal a) { _mm256_store_pd(p, a); }
+static inline vreal vset1(real_t a) { return _mm256_set1_pd(a); }
+static inline vreal vadd(vreal a, vreal b) { return _mm256_add_pd(a, b); }
+static inline vreal vsub(vreal a, vreal b) { return _mm256_sub_pd(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm256_mul_pd(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm256_div_pd(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm256_sqrt_pd(a); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BATCH_LANES 2
+typedef __m128d vreal;
+static inline vreal vload(const real_t *p) { return _mm_load_pd(p); }
+static inline void vstore(real_t *p, vreal a) { _mm_store_pd(p, a); }
+static inline vreal vset1(real_t a) { return _mm_set1_pd(a); }
+static inline vreal vadd(vreal a, vreal b) { return _mm_add_pd(a, b); }
+static inline vreal vsub(vreal a, vreal b) { return _mm_sub_pd(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm_mul_pd(a, b); }
+static inline vreal vdiv(vreal a, vreal b) { return _mm_div_pd(a, b); }
+static inline vreal vsqrt(vreal a) { return _mm_sqrt_pd(a); }
+#else
+#define BATCH_LANES 1
+typedef real_t vreal;
+static inline vreal vload(const real_t *p) { return *p; }
+static inline void vstore(real_t *p, vreal a) { *p = a; }
+static inline vreal vset1(real_t a) { return a; }
+static inline vreal vadd(vreal a, vreal b) { return a + b; }
+static inline vreal vsub(vreal a, vreal b) { return a - b; }
+static inline vreal vmul(vreal a, vreal b) { return a * b; }
+static inline vreal vdiv(vreal a, vreal b) { return a / b; }
+static inline vreal vsqrt(vreal a) { return sqrt(a); }
+#endif
+
+#define BATCH_ALIGNMENT 64
+// reals in a cache line
+#define BATCH_LINE (BATCH_ALIGNMENT / (int) sizeof(real_t))
+
+BodyBatch::BodyBatch() : data(NULL), count(0), stride(0), capacity(0)
+{
+}
+
+BodyBatch::~BodyBatch()
+{
+    free(data);
+}
+
+void BodyBatch::resize(int i_count)
+{
+    count = i_count;
+    // Whole cache lines per component, and an odd number of them. With a
+    // power of two stride every component of a body would fall in the same
+    // cache set and the streams would keep evicting each other.
+    stride = (count + BATCH_LINE - 1) / BATCH_LINE * BATCH_LINE;
+    if((stride / BATCH_LINE) % 2 == 0)
+        stride += BATCH_LINE;
+    if(stride > capacity){
+        free(data);
+        void *p = NULL;
+        if(posix_memalign(&p, BATCH_ALIGNMENT, sizeof(real_t)*stride*BATCH_NUM_COMPONENTS) != 0)
+            abort();
+        data = (real_t *) p;
+        capacity = stride;
+    }
+
+    // the padding is a body at rest
+    for(int c = 0; c < BATCH_NUM_COMPONENTS; ++c){
+        real_t *comp = (*this)[c];
+        for(int j = count; j < stride; ++j)
+            comp[j] = c == BATCH_ORIENT_W ? 1.0 : 0.0;
+    }
+}
+
+/**
+ * x' = x + dx/dt * dt for one component.
+ **/
+static inline void step(real_t *x, const real_t *x_dot, int j, vreal dt)
+{
+    vstore(x + j, vadd(vload(x + j), vmul(vload(x_dot + j), dt)));
+}
+
+void batch_integrate_vel(BodyBatch &batch, real_t i_dt)
+{
+    vreal dt = vset1(i_dt);
+    const real_t *iinv[9];
+    for(int k = 0; k < 9; ++k)
+        iinv[k] = batch[BATCH_IINV + k];
+
+    for(int j = 0; j < batch.size(); j += BATCH_LANES){
+        for(int k = 0; k < 3; ++k){
+            step(batch[BATCH_MOMENTUM_X + k], batch[BATCH_FORCE_X + k], j, dt);
+            step(batch[BATCH_ANG_MOMENTUM_X + k], batch[BATCH_TORQUE_X + k], j, dt);
+        }
+
+        vreal inv_mass = vload(batch[BATCH_INV_MASS] + j);
+        vreal L[3];
+        for(int k = 0; k < 3; ++k){
+            vstore(batch[BATCH_VEL_X + k] + j, vmul(vload(batch[BATCH_MOMENTUM_X + k] + j), inv_mass));
+            L[k] = vload(batch[BATCH_ANG_MOMENTUM_X + k] + j);
+        }
+
+        // omega = Iinv * L
+        for(int r = 0; r < 3; ++r){
+            vreal w = vadd(vadd(vmul(vload(iinv[r] + j), L[0]),
+                                vmul(vload(iinv[3 + r] + j), L[1])),
+                           vmul(vload(iinv[6 + r] + j), L[2]));
+            vstore(batch[BATCH_OMEGA_X + r] + j, w);
+        }
+    }
+}
+
+void batch_integrate_pos(BodyBatch &batch, real_t i_dt)
+{
+    vreal dt = vset1(i_dt);
+    vreal zero = vset1(0.0);
+    vreal half = vset1(0.5);
+    vreal one = vset1(1.0);
+    vreal two = vset1(2.0);
+
+    for(int j = 0; j < batch.size(); j += BATCH_LANES){
+        for(int k = 0; k < 3; ++k)
+            step(batch[BATCH_POS_X + k], batch[BATCH_VEL_X + k], j, dt);
+
+        // d(quat)/dt = 0.5 * (0, omega) * quat
+        vreal hw = vmul(zero, half);
+        vreal hx = vmul(vload(batch[BATCH_OMEGA_X] + j), half);
+        vreal hy = vmul(vload(batch[BATCH_OMEGA_Y] + j), half);
+        vreal hz = vmul(vload(batch[BATCH_OMEGA_Z] + j), half);
+        vreal qw = vload(batch[BATCH_ORIENT_W] + j);
+        vreal qx = vload(batch[BATCH_ORIENT_X] + j);
+        vreal qy = vload(batch[BATCH_ORIENT_Y] + j);
+        vreal qz = vload(batch[BATCH_ORIENT_Z] + j);
+
+        vreal dw = vsub(vsub(vsub(vmul(hw, qw), vmul(hx, qx)), vmul(hy, qy)), vmul(hz, qz));
+        vreal dx = vsub(vadd(vadd(vmul(hw, qx), vmul(hx, qw)), vmul(hy, qz)), vmul(hz, qy));
+        vreal dy = vsub(vadd(vadd(vmul(hw, qy), vmul(hy, qw)), vmul(hz, qx)), vmul(hx, qz));
+        vreal dz = vsub(vadd(vadd(vmul(hw, qz), vmul(hz, qw)), vmul(hx, qy)), vmul(hy, qx));
+        qw = vadd(qw, vmul(dw, dt));
+        qx = vadd(qx, vmul(dx, dt));
+        qy = vadd(qy, vmul(dy, dt));
+        qz = vadd(qz, vmul(dz, dt));
+
+        // normalize
+        vreal len2 = vadd(vadd(vadd(vmul(qx, qx), vmul(qy, qy)), vmul(qz, qz)), vmul(qw, qw));
+        vreal maginv = vdiv(one, vsqrt(len2));
+        qw = vmul(qw, maginv);
+        qx = vmul(qx, maginv);
+        qy = vmul(qy, maginv);
+        qz = vmul(qz, maginv);
+        vstore(batch[BATCH_ORIENT_W] + j, qw);
+        vstore(batch[BATCH_ORIENT_X] + j, qx);
+        vstore(batch[BATCH_ORIENT_Y] + j, qy);
+        vstore(batch[BATCH_ORIENT_Z] + j, qz);
+
+        // R, the columns are the body axes
+        vreal x2 = vmul(two, qx);
+        vreal y2 = vmul(two, qy);
+        vreal z2 = vmul(two, qz);
+        vreal xw2 = vmul(x2, qw);
+        vreal yw2 = vmul(y2, qw);
+        vreal zw2 = vmul(z2, qw);
+        vreal xx2 = vmul(x2, qx);
+        vreal xy2 = vmul(y2, qx);
+        vreal xz2 = vmul(z2, qx);
+        vreal yy2 = vmul(y2, qy);
+        vreal yz2 = vmul(z2, qy);
+        vreal zz2 = vmul(z2, qz);
+
+        vreal R[9];
+        R[0] = vsub(one, vadd(yy2, zz2));
+        R[1] = vadd(xy2, zw2);
+        R[2] = vsub(xz2, yw2);
+        R[3] = vsub(xy2, zw2);
+        R[4] = vsub(one, vadd(xx2, zz2));
+        R[5] = vadd(yz2, xw2);
+        R[6] = vadd(xz2, yw2);
+        R[7] = vsub(yz2, xw2);
+        R[8] = vsub(one, vadd(xx2, yy2));
+
+        // Iinv = (R * Iinv_body) * R_t
+        vreal Ib[9], T[9];
+        for(int k = 0; k < 9; ++k){
+            vstore(batch[BATCH_R + k] + j, R[k]);
+            Ib[k] = vload(batch[BATCH_IINV_BODY + k] + j);
+        }
+        for(int c = 0; c < 3; ++c){
+            for(int r = 0; r < 3; ++r){
+                T[3*c + r] = vadd(vadd(vmul(R[r], Ib[3*c]), vmul(R[3 + r], Ib[3*c + 1])),
+                                  vmul(R[6 + r], Ib[3*c + 2]));
+            }
+        }
+        for(int c = 0; c < 3; ++c){
+            for(int r = 0; r < 3; ++r){
+                // R_t[c][k] is R[k][c]
+                vreal m = vadd(vadd(vmul(T[r], R[c]), vmul(T[3 + r], R[3 + c])),
+                               vmul(T[6 + r], R[6 + c]));
+                vstore(batch[BATCH_IINV + 3*c + r] + j, m);
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file BatchIntegrator.h
+ * @brief Euler integration of many bodies at once from structure of arrays buffers.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include "Math.h"
+
+/**
+ * The components of a body the batch kernels read or write, one array each.
+ * Matrices are stored by column like Matrix3::m.
+ */
+enum BatchComponent
+{
+    BATCH_POS_X, BATCH_POS_Y, BATCH_POS_Z,
+    BATCH_ORIENT_W, BATCH_ORIENT_X, BATCH_ORIENT_Y, BATCH_ORIENT_Z,
+    BATCH_MOMENTUM_X, BATCH_MOMENTUM_Y, BATCH_MOMENTUM_Z,
+    BATCH_ANG_MOMENTUM_X, BATCH_ANG_MOMENTUM_Y, BATCH_ANG_MOMENTUM_Z,
+    BATCH_VEL_X, BATCH_VEL_Y, BATCH_VEL_Z,
+    BATCH_OMEGA_X, BATCH_OMEGA_Y, BATCH_OMEGA_Z,
+    BATCH_FORCE_X, BATCH_FORCE_Y, BATCH_FORCE_Z,
+    BATCH_TORQUE_X, BATCH_TORQUE_Y, BATCH_TORQUE_Z,
+    BATCH_INV_MASS,
+    BATCH_R,                                  // 9 entries
+    BATCH_IINV_BODY = BATCH_R + 9,            // 9 entries
+    BATCH_IINV = BATCH_IINV_BODY + 9,         // 9 entries
+    BATCH_NUM_COMPONENTS = BATCH_IINV + 9
+};
+
+/**
+ * The state of a set of bodies laid out as one array per component, so the
+ * kernels can step several bodies with each vector instruction.
+ *
+ * The arrays are aligned and padded to a whole number of vector lanes. The
+ * padding holds a body at rest with the identity orientation, so the kernels
+ * can run over it without producing NaNs.
+ */
+class BodyBatch
+{
+public:
+    BodyBatch();
+    ~BodyBatch();
+
+    /**
+     * Sets the number of bodies. The contents are undefined afterwards.
+     */
+    void resize(int count);
+    int size() const { return count; }
+
+    real_t* operator[](int component) { return data + component*stride; }
+    const real_t* operator[](int component) const { return data + component*stride; }
+
+private:
+    BodyBatch(const BodyBatch&);
+    BodyBatch& operator=(const BodyBatch&);
+
+    real_t *data;
+    int count;
+    // length of each component array, count rounded up to the vector width
+    int stride;
+    int capacity;
+};
+
+/**
+ * Euler steps the momenta of every body by the forces and torques, then
+ * derives the velocities from them with the current world inverse inertia.
+ * Same as System::set_state_vel after an EulerRBIntegrator step.
+ */
+void batch_integrate_vel(BodyBatch &batch, real_t dt);
+
+/**
+ * Euler steps the positions and orientations of every body by the
+ * velocities, renormalizes the orientations and rebuilds R and the world
+ * inverse inertia from them. Same as System::set_state_pos after an
+ * EulerRBIntegrator step.
+ */
+void batch_integrate_pos(BodyBatch &batch, real_t dt);
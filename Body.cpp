@@ -1,70 +1,161 @@
 #include "Body.h"
 #include <GLUT/glut.h>
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+
+BodyCold::BodyCold(const Vec3 &i_ConstructPos, const Quaternion &i_ConstructOrien, const Model* i_model,
+                   const Color3 &i_color, const real_t i_restitution) :
+                   ConstructPos(i_ConstructPos), ConstructOrien(i_ConstructOrien),
+                   model(i_model), color(i_color), restitution(i_restitution),
+                   index(-1), lowlink(-1), in_stack(false), SCC_num(0)
+{
+}
 
 Body::Body(const Vec3 & i_ConstructPos, const Quaternion & i_ConstructOrien,
-           Model* i_model, Vec3 i_size, const double i_restitution,
-           const double i_coef_friction, const double i_inv_mass) :
-           ConstructPos(i_ConstructPos), ConstructOrien(i_ConstructOrien),
+           const Model* i_model, const Color3 &i_color, Vec3 i_size, const real_t i_restitution,
+           const real_t i_coef_friction, const real_t i_inv_mass) :
            Position(i_ConstructPos), Orientation(i_ConstructOrien),
-           Velocity(Vec3(0.0, 0.0, 0.0)), Momentum(Vec3(0.0, 0.0, 0.0)),
-           Omega(Vec3(0.0, 0.0, 0.0)), AngularMomentum(Vec3(0.0, 0.0, 0.0)),
+           Velocity(Vec3(0.0, 0.0, 0.0)), Omega(Vec3(0.0, 0.0, 0.0)),
+           inv_mass(i_inv_mass), radius(norm(i_size)), construct_inv_mass(i_inv_mass),
+           coef_friction(i_coef_friction), size(i_size), shape(i_model->shape_type()),
+           Momentum(Vec3(0.0, 0.0, 0.0)), AngularMomentum(Vec3(0.0, 0.0, 0.0)),
            forces(Vec3(0.0, 0.0, 0.0)), torques(Vec3(0.0, 0.0, 0.0)),
-           model(i_model), size(i_size), radius(norm(size)), inv_mass(i_inv_mass),
-           construct_inv_mass(i_inv_mass), restitution(i_restitution),
-           coef_friction(i_coef_friction), index(-1), lowlink(-1), in_stack(false)
+           omega_valid(false), id(-1), asleep(false), sleep_time(0.0), island(-1),
+           info_saved(false),
+           cold(new BodyCold(i_ConstructPos, i_ConstructOrien, i_model, i_color, i_restitution)),
+           derived_valid(false), prev_valid(false)
 {
     // calculate derived quantities
     Orientation.to_matrix(&R);
     transpose(&R_t, R);
-    model->get_Iinv(Iinv_body, size, inv_mass);
+    i_model->get_Iinv(Iinv_body, size, inv_mass);
     Iinv = R*Iinv_body*R_t;
 }
 
+Body::Body(const Body &o, BodyCold *i_cold) :
+           Position(o.Position), Orientation(o.Orientation), R(o.R),
+           Velocity(o.Velocity), Omega(o.Omega), Iinv(o.Iinv),
+           inv_mass(o.inv_mass), radius(o.radius), construct_inv_mass(o.construct_inv_mass),
+           coef_friction(o.coef_friction), size(o.size), shape(o.shape),
+           Momentum(o.Momentum), AngularMomentum(o.AngularMomentum), R_t(o.R_t),
+           forces(o.forces), torques(o.torques), Iinv_body(o.Iinv_body),
+           omega_key(o.omega_key), omega_valid(o.omega_valid), id(o.id),
+           asleep(o.asleep), sleep_time(o.sleep_time), island(o.island),
+           info_saved(o.info_saved), in_contact_list(o.in_contact_list),
+           cold(i_cold),
+           derived_key(o.derived_key), derived_valid(o.derived_valid),
+           prev_key(o.prev_key), prev_orientation(o.prev_orientation),
+           prev_R(o.prev_R), prev_R_t(o.prev_R_t), prev_Iinv(o.prev_Iinv), prev_valid(o.prev_valid)
+{
+}
+
 Body::~Body(void)
 {
-    delete model;
+    delete cold;
+}
+
+void* Body::operator new(size_t size)
+{
+    void *p = NULL;
+    if(posix_memalign(&p, BODY_ALIGNMENT, size) != 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void Body::operator delete(void *p)
+{
+    free(p);
 }
 
 void Body::reset()
 {
-    Position = ConstructPos;
-    Orientation = ConstructOrien;
+    Position = cold->ConstructPos;
+    Orientation = cold->ConstructOrien;
     Velocity = Vec3(0.0, 0.0, 0.0);
     Momentum = Vec3(0.0, 0.0, 0.0);
     Omega = Vec3(0.0, 0.0, 0.0);
     AngularMomentum = Vec3(0.0, 0.0, 0.0);
     forces = Vec3(0.0, 0.0, 0.0);
     torques = Vec3(0.0, 0.0, 0.0);
+    asleep = false;
+    sleep_time = 0.0;
+    island = -1;
+    info_saved = false;
+    derived_valid = false;
+    prev_valid = false;
+    omega_valid = false;
     Orientation.to_matrix(&R);
     transpose(&R_t, R);
-    model->get_Iinv(Iinv_body, size, inv_mass);
+    cold->model->get_Iinv(Iinv_body, size, inv_mass);
     Iinv = R*Iinv_body*R_t;
 }
 
 void Body::draw()
+{
+    draw(Position, Orientation);
+}
+
+void Body::draw(const Vec3 &pos, const Quaternion &orientation)
 {
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
-    glTranslated(Position[0], Position[1], Position[2]);
+    glTranslated(pos[0], pos[1], pos[2]);
     Vec3 axis;
-    double angle;
-    Orientation.to_axis_angle(&axis, &angle);
+    real_t angle;
+    orientation.to_axis_angle(&axis, &angle);
     glRotated(angle*180/PI, axis[0], axis[1], axis[2]);
-    glScaled(size[0], size[1], size[2]);
-    model->render();
+    if(cold->model->shape_type() == SHAPE_PLANE)
+    { // a plane has no height, and scaling its quad by that would leave no inverse for its normal
+        glScaled(size[0], 1.0, size[2]);
+    }
+    else
+    {
+        glScaled(size[0], size[1], size[2]);
+    }
+    cold->model->render(cold->color);
     glPopMatrix();
 }
 
 #if USE_XENOCOLLIDE
+MPRStats Body::mpr_stats;
+
+/**
+ * Finds the support point of the body furthest along the world direction dir.
+ **/
+static Vec3 support(const Body *body, const Quaternion &inv_orientation, const Vec3 &dir)
+{
+	MPR_COUNT(support_calls);
+	Vec3 v = body->cold->model->GetSupportPoint(inv_orientation*dir);
+	body->TransformBodyToWorld(v);
+	return v;
+}
+
+/**
+ * Remembers the direction which proved body1 and body2 apart, in the frame of body1.
+ **/
+static void cache_separating_axis(MPRCache *cache, const Quaternion &inv_orientation1, const Vec3 &dir)
+{
+	if(cache)
+	{
+		cache->local_dir = inv_orientation1*dir;
+		cache->separating = true;
+		cache->valid = true;
+	}
+}
+
 /**
  * p1 and p2 are the positions of collision in world space on each body
  * and normal is normal of the collision also in world space.
  * Uses the Xeno collide algorithm to detect collisions.
+ * If a cache is given the direction found by the last test of the same pair
+ * is tried first and the direction found by this test is stored in it.
  **/
-bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3 &normal)
+bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3 &normal, MPRCache *cache)
 {
+	MPR_COUNT(tests);
 	Vec3 v0 = body2->Position - body1->Position; // Center of Minkowski difference
-	double dist_between_centers = norm(v0);
+	real_t dist_between_centers = norm(v0);
 	
 	// check bounding sphere intersection
 	if(dist_between_centers > body1->radius + body2->radius)
@@ -73,7 +164,7 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 	}
 	
 	// Centers overlap
-	if(IsZero(dist_between_centers))
+	if(dist_between_centers < EPSILON)
 	{
 		// Pick an arbitrary direction
 		v0 = Vec3(0, EPSILON, 0);
@@ -84,22 +175,43 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 	inv_orientation1 = conjugate(body1->Orientation);
 	inv_orientation2 = conjugate(body2->Orientation);
 	
-	// Get the closest support point on the convex hull of the Minkowski difference
+	// Start searching toward the origin from the center of the Minkowski difference
 	normal = -v0;
-	Vec3 v11 = body1->model->GetSupportPoint(inv_orientation1*(-normal));
-	body1->TransformBodyToWorld(v11);
-	Vec3 v12 = body2->model->GetSupportPoint(inv_orientation2*normal);
-	body2->TransformBodyToWorld(v12);
+	if(cache && cache->valid)
+	{
+		Vec3 cached_dir = body1->Orientation*cache->local_dir;
+		if(cache->separating)
+		{ // Bodies which were apart usually still are, so check the old separating axis first.
+			Vec3 s1 = support(body1, inv_orientation1, -cached_dir);
+			Vec3 s2 = support(body2, inv_orientation2, cached_dir);
+			if((s2 - s1)*cached_dir < 0.0)
+			{
+				MPR_COUNT(early_outs);
+				return false;
+			}
+		}
+		else if(cached_dir*normal > 0.0)
+		{ // The last contact normal still points toward the origin so start the portal
+		  // there. The first support point then usually lands on the contact feature.
+			normal = cached_dir;
+			MPR_COUNT(seeded);
+		}
+	}
+
+	// Get the closest support point on the convex hull of the Minkowski difference
+	Vec3 v11 = support(body1, inv_orientation1, -normal);
+	Vec3 v12 = support(body2, inv_orientation2, normal);
 	Vec3 v1 = v12 - v11;
 	
     if (v1*normal <= 0.0)
     { // v0 is on the surface of convex hull of the minkowski difference
 	  // and the origin in on the outside, in the direction of the normal.
+		cache_separating_axis(cache, inv_orientation1, normal);
         return false;
     }
 	
 	normal = cross(v1, v0);
-	if(IsZero(norm(normal)))
+	if(norm(normal) < EPSILON)
 	{ // v0, v1 and the origin are in a line and since v1 is away from the center,
 	  // this means the origin is closer to the center than a support point is
 	  // along a direct line, so the origin has to be inside the minkowski difference.
@@ -113,15 +225,14 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 		return true;
 	}
 	
-	Vec3 v21 = body1->model->GetSupportPoint(inv_orientation1*(-normal));
-	body1->TransformBodyToWorld(v21);
-	Vec3 v22 = body2->model->GetSupportPoint(inv_orientation2*normal);
-	body2->TransformBodyToWorld(v22);
+	Vec3 v21 = support(body1, inv_orientation1, -normal);
+	Vec3 v22 = support(body2, inv_orientation2, normal);
 	Vec3 v2 = v22 - v21;
 	
 	if(v2*normal <= 0.0)
 	{ // v0 is on the surface of convex hull of the minkowski difference
 	  // and the origin in on the outside, in the direction of the normal.
+		cache_separating_axis(cache, inv_orientation1, normal);
 		return false;
 	}
 	
@@ -144,15 +255,14 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 	// Find a portal
 	while(true)
 	{
-		Vec3 v31 = body1->model->GetSupportPoint(inv_orientation1*(-normal));
-		body1->TransformBodyToWorld(v31);
-		Vec3 v32 = body2->model->GetSupportPoint(inv_orientation2*normal);
-		body2->TransformBodyToWorld(v32);
+		Vec3 v31 = support(body1, inv_orientation1, -normal);
+		Vec3 v32 = support(body2, inv_orientation2, normal);
 		Vec3 v3 = v32 - v31;
 		
 		if(v3*normal <= 0.0)
 		{ // v0 is on the surface of convex hull of the minkowski difference
 		  // and the origin in on the outside, in the direction of the normal.
+			cache_separating_axis(cache, inv_orientation1, normal);
 			return false;
 		}
 		
@@ -183,26 +293,24 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 			unitize(normal);
 			float dot = normal*v1;
 
-			Vec3 v41 = body1->model->GetSupportPoint(inv_orientation1*(-normal));
-			body1->TransformBodyToWorld(v41);
-			Vec3 v42 = body2->model->GetSupportPoint(inv_orientation2*normal);
-			body2->TransformBodyToWorld(v42);
+			Vec3 v41 = support(body1, inv_orientation1, -normal);
+			Vec3 v42 = support(body2, inv_orientation2, normal);
 			Vec3 v4 = v42 - v41;
 
-			double delta = (v4 - v3)*normal;
-			double separation = -(v4*normal);
+			real_t delta = (v4 - v3)*normal;
+			real_t separation = -(v4*normal);
 
 			// modified to deal with nans, need to verify that my logic is still correct.
 			if (!(delta > 1e-4) || !(separation < 0.0))
 			{
 				if (dot > -EPSILON)
 				{
-					double b0 = cross(v1, v2)*v3;
-					double b1 = cross(v3, v2)*v0;
-					double b2 = cross(v0, v1)*v3;
-					double b3 = cross(v2, v1)*v0;
+					real_t b0 = cross(v1, v2)*v3;
+					real_t b1 = cross(v3, v2)*v0;
+					real_t b2 = cross(v0, v1)*v3;
+					real_t b3 = cross(v2, v1)*v0;
 
-					double sum = b0 + b1 + b2 + b3;
+					real_t sum = b0 + b1 + b2 + b3;
 
 					if (sum <= 0.0)
 					{
@@ -214,7 +322,7 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 						sum = b1 + b2 + b3;
 					}
 
-					double inv = (1.0 / sum);
+					real_t inv = (1.0 / sum);
 
 					Vec3 wa = (b0*body1->Position + b1*v11 + b2*v21 + b3*v31) * inv;
 					Vec3 wb = (b0*body2->Position + b1*v12 + b2*v22 + b3*v32) * inv;
@@ -228,16 +336,26 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 					// printf("with b1 at postition (%g, %g, %g) and b2 at postition (%g, %g, %g)\n", body1->Position[0], body1->Position[1], body1->Position[2],
 					// 	body2->Position[0], body2->Position[1], body2->Position[2]);
 					unitize(normal);
+					if(cache)
+					{
+						cache->local_dir = inv_orientation1*normal;
+						cache->separating = false;
+						cache->valid = true;
+					}
 					return true;
 				}
 
+				if(separation >= 0.0)
+				{ // the support point along the portal normal is behind the origin
+					cache_separating_axis(cache, inv_orientation1, normal);
+				}
 				return false;
 			}
 
-			double d1 = cross(v4, v1)*v0;
+			real_t d1 = cross(v4, v1)*v0;
 			if (d1 < 0.0f)
 			{
-				double d2 = cross(v4, v2)*v0;
+				real_t d2 = cross(v4, v2)*v0;
 				if (d2 < 0.0f)
 				{
 					v1 = v4;
@@ -253,7 +371,7 @@ bool Body::intersection_test(Body *body1, Body* body2, Vec3 &p1, Vec3 & p2, Vec3
 			}
 			else
 			{
-				double d3 = cross(v4, v3)*v0;
+				real_t d3 = cross(v4, v3)*v0;
 				if (d3 < 0.0f)
 				{
 					v2 = v4;
@@ -286,12 +404,12 @@ bool Body::intersection_test(Body *body_o, Vec3 &p, Vec3 &normal)
     int num_pen_verts = 0;
     Vec3 inter_point(0,0,0);
     normal = Vec3(0,0,0);
-    for(int i = 0; i < body_o->model->num_vertices(); ++i){
+    for(int i = 0; i < body_o->cold->model->num_vertices(); ++i){
         Vec3 pos, w_pos, n;
         w_pos = body_o->get_vertex_world_position(i);
 		pos = w_pos;
         get_vertex_in_body_space(pos);
-        if(model->intersection_test(pos, n)){
+        if(cold->model->intersection_test(pos, n)){
             Vec3 r1 = w_pos - Position;
             Vec3 r2 = w_pos - body_o->Position;
             Vec3 u_rel = body_o->get_vel(r2) - get_vel(r1);
@@ -310,9 +428,9 @@ bool Body::intersection_test(Body *body_o, Vec3 &p, Vec3 &normal)
     // find the closest normal to the average point
 	Vec3 local_p = p;
     get_vertex_in_body_space(local_p);
-    double abs_x = fabs(local_p[0]);
-    double abs_y = fabs(local_p[1]);
-    double abs_z = fabs(local_p[2]);
+    real_t abs_x = fabs(local_p[0]);
+    real_t abs_y = fabs(local_p[1]);
+    real_t abs_z = fabs(local_p[2]);
     if(abs_x < abs_y){
         if(abs_y < abs_z){ // closest to z-face
             normal = Vec3(0,0,local_p[2]/abs_z);
@@ -332,22 +450,76 @@ bool Body::intersection_test(Body *body_o, Vec3 &p, Vec3 &normal)
 }
 #endif
 
+void Body::set_orientation(const Quaternion &q)
+{
+    if(derived_valid && q == derived_key)
+        return;
+
+    if(prev_valid && q == prev_key){
+        // a rollback, the values from before the last change are still good
+        std::swap(Orientation, prev_orientation);
+        std::swap(R, prev_R);
+        std::swap(R_t, prev_R_t);
+        std::swap(Iinv, prev_Iinv);
+        std::swap(derived_key, prev_key);
+        prev_valid = derived_valid;
+        derived_valid = true;
+        omega_valid = false;
+        return;
+    }
+
+    invalidate_derived();
+    Orientation = normalize(q);
+    Orientation.to_matrix(&R);
+    transpose(&R_t, R);
+    Iinv = R * Iinv_body * R_t;
+    derived_key = q;
+    derived_valid = true;
+}
+
+void Body::set_angular_momentum(const Vec3 &L)
+{
+    AngularMomentum = L;
+    if(omega_valid && L[0] == omega_key[0] && L[1] == omega_key[1] && L[2] == omega_key[2])
+        return;
+
+    Omega = Iinv * AngularMomentum;
+    omega_key = L;
+    omega_valid = true;
+}
+
+void Body::invalidate_derived()
+{
+    if(derived_valid){
+        prev_key = derived_key;
+        prev_orientation = Orientation;
+        prev_R = R;
+        prev_R_t = R_t;
+        prev_Iinv = Iinv;
+        prev_valid = true;
+        derived_valid = false;
+    }
+    omega_valid = false;
+}
+
 void Body::getInfo(BodyInfo &b){
     b.Pos = Position;
     b.Orientation = Orientation;
     b.size = size;
-    b.color = model->material->diffuse;
+    b.color = cold->color;
 }
 
 /**
-* calculates K as defined in Rigid Bodies Paper
+* calculates K as defined in Rigid Bodies Paper, 1/m + r*^T Iinv r*. Iinv is
+* symmetric, being R Iinv_body R^T with Iinv_body diagonal, and so is K.
 **/
-Matrix3 Body::get_K(Vec3 world_rel_pos)
+SymMat3 Body::get_K(const Vec3 &world_rel_pos) const
 {
-    Matrix3 r_star, r_star_t;
-    r_star = star(world_rel_pos);
-    transpose(&r_star_t, r_star);
-    return Matrix3::Identity*inv_mass + r_star_t * Iinv * r_star;
+    SymMat3 K = star_congruence(Iinv, world_rel_pos);
+    K(0, 0) += inv_mass;
+    K(1, 1) += inv_mass;
+    K(2, 2) += inv_mass;
+    return K;
 }
 
 /**
@@ -363,7 +535,7 @@ Vec3 Body::get_vel(Vec3 world_rel_pos)
 **/
 Vec3 Body::get_vertex_world_position(int i) const
 {
-    Vec3 p = model->mesh->get_vertex(i).position;
+    Vec3 p = cold->model->mesh->get_vertex(i).position;
     // scale p
     for(int k = 0; k < 3; ++k)
         p[k] *= size[k];
@@ -390,10 +562,10 @@ void Body::TransformBodyToWorld(Vec3 &body_pos) const
 **/
 Vec3 Body::get_vertex_world_normal(int i) const
 {
-    Vec3 n = model->mesh->get_vertex(i).normal;
+    Vec3 n = cold->model->mesh->get_vertex(i).normal;
     // scale
     for(int k = 0; k < 3; ++k)
-        n[k] /= (double) size[k];
+        n[k] /= (real_t) size[k];
     unitize(n);
     // rotate n
     return Orientation*n;
@@ -410,16 +582,27 @@ void Body::get_vertex_in_body_space(Vec3 &world_pos) const
     world_pos = conjugate(Orientation)*world_pos;
     // scale pos
     for(int k = 0; k < 3; ++k)
-        world_pos[k] /= (double) size[k];
+        world_pos[k] /= (real_t) size[k];
     //printf("local pos: %f %f %f\n", world_pos[0], world_pos[1], world_pos[2]);
 }
 
 /**
- * computes a matrix equivalent of v cross
+ * computes the world space bounding box of the body grown by margin on every side
  **/
-Matrix3 Body::star(Vec3 v)
+void Body::get_aabb(AABB &box, real_t margin) const
 {
-    return Matrix3( 0.0, -v[2],  v[1],
-                    v[2],   0.0, -v[0],
-                    -v[1],  v[0],  0.0);
+    // a tilted half space reaches everywhere, so a plane's box is all of space
+    if(shape == SHAPE_PLANE)
+    {
+        box.lo = Vec3(-HUGE_VAL, -HUGE_VAL, -HUGE_VAL);
+        box.hi = Vec3(HUGE_VAL, HUGE_VAL, HUGE_VAL);
+        return;
+    }
+
+    // the extent along a world axis is the sum of the projected half sizes of the body axes
+    Vec3 half;
+    for(int k = 0; k < 3; ++k)
+        half[k] = 0.5*(fabs(R(0, k))*size[0] + fabs(R(1, k))*size[1] + fabs(R(2, k))*size[2]) + margin;
+    box.lo = Position - half;
+    box.hi = Position + half;
 }
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <gfx/vec2.h>
+#include <stddef.h>
 #include "quaternion.h"
 #include "matrix.h"
 #include "Model.h"
+#include "AABB.h"
 
 struct BodyInfo{
 	Vec3 Pos;
@@ -12,18 +14,108 @@ struct BodyInfo{
 	Color3 color;
 };
 
+#if USE_XENOCOLLIDE
+/**
+ * The search direction left by the last XenoCollide test of a pair of bodies,
+ * in the frame of the first body of the test.
+ */
+struct MPRCache{
+	Vec3 local_dir;
+	// true if local_dir separated the bodies, otherwise it was the contact normal
+	bool separating;
+	bool valid;
+
+	MPRCache() : separating(false), valid(false) {}
+};
+
+/**
+ * Counts of the work done by the XenoCollide tests. Every thread would share
+ * the counters' cache line, so they are only kept when MPR_STATS is defined,
+ * and are then updated atomically since the islands may be tested on several
+ * threads.
+ */
+struct MPRStats{
+	unsigned long tests;
+	unsigned long support_calls;
+	// tests ended by a cached separating axis
+	unsigned long early_outs;
+	// tests started from a cached contact normal
+	unsigned long seeded;
+
+	MPRStats() : tests(0), support_calls(0), early_outs(0), seeded(0) {}
+};
+
+#ifdef MPR_STATS
+#define MPR_COUNT(counter) __sync_fetch_and_add(&Body::mpr_stats.counter, 1)
+#else
+#define MPR_COUNT(counter) ((void) 0)
+#endif
+#endif
+
+// the hot state of a body starts on a cache line of its own
+#define BODY_ALIGNMENT 64
+
+/**
+ * The parts of a body which the collision and contact passes rarely read:
+ * the pose it was built at, its model and colour, its restitution, which is
+ * only read by collisions, and the bookkeeping of the search for the strongly
+ * connected components of the contact graph, which runs once a frame. They
+ * are kept out of the Body so they do not take up the cache lines the
+ * narrowphase and solver pull in for every pair.
+ */
+struct BodyCold{
+    BodyCold(const Vec3 &i_ConstructPos, const Quaternion &i_ConstructOrien, const Model* i_model,
+             const Color3 &i_color, const real_t i_restitution);
+
+    const Vec3 ConstructPos;
+    const Quaternion ConstructOrien;
+    const Model* model;
+    Color3 color;
+    const real_t restitution;
+
+    int index;
+    int lowlink;
+    bool in_stack;
+    int SCC_num;
+};
+
+/**
+ * A rigid body. The state read by every narrowphase test and solver iteration
+ * comes first, in one cache line aligned block, followed by the rest of the
+ * state the integrators and the sleep test use, and last the orientations
+ * kept for rollbacks. Everything else is in the cold record, which the body
+ * owns unless it lives in a BodyStore. Bodies are not copied, other than by
+ * the store when it takes them over.
+ */
 class Body
 {
 public:
 
-    Body(const Vec3 & i_ConstructPos, const Quaternion & i_ConstructOrien, Model* i_model,
-        Vec3 i_size, const double restitution, const double coef_friction, const double i_inv_mass);
+    /**
+     * The model is shared with the other bodies of its shape and is not
+     * owned by the body, see ShapeRegistry.
+     */
+    Body(const Vec3 & i_ConstructPos, const Quaternion & i_ConstructOrien, const Model* i_model,
+        const Color3 &i_color, Vec3 i_size, const real_t restitution, const real_t coef_friction, const real_t i_inv_mass);
     ~Body(void);
 
+    /**
+     * Bodies are allocated on a BODY_ALIGNMENT boundary, which plain new only
+     * promises for alignments up to 16 bytes before C++17.
+     */
+    static void* operator new(size_t size);
+    static void operator delete(void *p);
+    // placement new, for the BodyStore
+    static void* operator new(size_t size, void *p) { return p; }
+    static void operator delete(void *p, void *place) {}
+
     void reset();
     void draw();
+    // draws the body at a pose other than its own
+    void draw(const Vec3 &pos, const Quaternion &orientation);
 #if USE_XENOCOLLIDE
-    static bool intersection_test(Body* body1, Body* body2, Vec3& p1, Vec3& p2, Vec3 &normal);
+    static bool intersection_test(Body* body1, Body* body2, Vec3& p1, Vec3& p2, Vec3 &normal, MPRCache *cache = NULL);
+    static MPRStats mpr_stats;
 #else
 	bool intersection_test(Body *body_o, Vec3 &p, Vec3 &normal);
 #endif
@@ -32,37 +124,98 @@ public:
     Vec3 get_vertex_world_normal(int i) const;
     void get_vertex_in_body_space(Vec3 &world_pos) const;
     void getInfo(BodyInfo &);
-    Matrix3 get_K(Vec3 pos);
+    SymMat3 get_K(const Vec3 &pos) const;
     Vec3 get_vel(Vec3 pos);
-    Matrix3 star(Vec3 v);
+    void get_aabb(AABB &box, real_t margin) const;
 
-    const Vec3 ConstructPos;
-    const Quaternion ConstructOrien;
-    Vec3 Position;
-    Matrix3 R;
-    Matrix3 R_t;
+    /**
+     * Sets the orientation, normalizing it, and brings R, R_t and Iinv up to
+     * date. They are only recomputed when q is not the orientation they were
+     * last derived from, or the one before it, so rolling a body back to the
+     * state it had before a trial step swaps the old values back in.
+     */
+    void set_orientation(const Quaternion &q);
+    /**
+     * Sets the angular momentum and brings Omega up to date, recomputing it
+     * only if L or Iinv changed since it was last derived.
+     */
+    void set_angular_momentum(const Vec3 &L);
+    /**
+     * Call before writing R, R_t or Iinv other than through set_orientation.
+     * The current values are kept as the previous ones, so a rollback to the
+     * orientation they were derived from still finds them.
+     */
+    void invalidate_derived();
+    /**
+     * Call after writing Omega or Iinv other than through set_angular_momentum
+     * and set_orientation.
+     */
+    void invalidate_omega() { omega_valid = false; }
+
+    // hot: read by every narrowphase test and impulse
+    Vec3 Position __attribute__((aligned(BODY_ALIGNMENT)));
     Quaternion Orientation;
+    Matrix3 R;
     Vec3 Velocity;
-    Vec3 Momentum;
     Vec3 Omega;
+    Matrix3 Iinv;
+    real_t inv_mass;
+    const real_t radius; // bounding sphere radius
+    const real_t construct_inv_mass;
+    const real_t coef_friction;
+    Vec3 size;
+    // the shape of the model, which picks the narrowphase test
+    const ShapeType shape;
+
+    // written with Velocity and Omega by every impulse
+    Vec3 Momentum;
     Vec3 AngularMomentum;
+    Matrix3 R_t;
     Vec3 forces;
     Vec3 torques;
-    Model* model;
     Matrix3 Iinv_body;
-    Matrix3 Iinv;
 	//Matrix3 construct_Iinv;
-    Vec3 size;
-    const double radius; // bounding sphere radius
-    double inv_mass;
-	const double construct_inv_mass;
-    const double restitution;
-    const double coef_friction;
+
+    // the angular momentum Omega was derived from with the current Iinv
+    Vec3 omega_key;
+    bool omega_valid;
+
+    // stable index assigned by the System, unaffected by reordering of its body list
+    int id;
+
+    // sleeping bodies are not integrated and only tested against awake bodies
+    bool asleep;
+    // how long the body has been moving slower than the sleep thresholds
+    real_t sleep_time;
+    // bodies which fell asleep together share an island and are woken together
+    int island;
+    // true once the state of the sleeping body has been saved for the clients
+    bool info_saved;
 
     // the contact graph. Holds the bodies which this one rests on top of
     std::vector<Body*> in_contact_list;
-    int index;
-    int lowlink;
-    bool in_stack;
-    int SCC_num;
+
+    BodyCold *cold;
+
+    // last, since they are only read by set_orientation, and by a rollback:
+    // the orientation R, R_t and Iinv were derived from, before normalizing
+    Quaternion derived_key;
+    bool derived_valid;
+    // the derived values of the orientation before that one
+    Quaternion prev_key;
+    Quaternion prev_orientation;
+    Matrix3 prev_R;
+    Matrix3 prev_R_t;
+    Matrix3 prev_Iinv;
+    bool prev_valid;
+
+private:
+    friend class BodyStore;
+    /**
+     * A copy of original using the given cold record, which the caller
+     * keeps ownership of.
+     */
+    Body(const Body &original, BodyCold *i_cold);
+    Body(const Body&);
+    Body& operator=(const Body&);
 };
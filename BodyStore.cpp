@@ -0,0 +1,65 @@
+/**
+ * @file BodyStore.cpp
+ * @brief Contiguous storage of the bodies of a System, indexed by Body::id.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "BodyStore.h"
+#include <stdlib.h>
+#include <new>
+
+BodyStore::BodyStore() : bodies(NULL), colds(NULL), count(0), stride(sizeof(Body))
+{
+}
+
+BodyStore::~BodyStore()
+{
+    clear();
+}
+
+void BodyStore::adopt(std::vector<Body*> &i_bodies)
+{
+    clear();
+    if(i_bodies.empty())
+        return;
+
+    // a stride of an even number of cache lines puts the hot state of many
+    // bodies in the same few cache sets, a power of two in a single one
+    stride = sizeof(Body);
+    if((stride / BODY_ALIGNMENT) % 2 == 0)
+        stride += BODY_ALIGNMENT;
+
+    void *p = NULL;
+    if(posix_memalign(&p, BODY_ALIGNMENT, stride*i_bodies.size()) != 0)
+        abort();
+    bodies = (char *) p;
+    colds = (BodyCold *) malloc(sizeof(BodyCold)*i_bodies.size());
+    if(!colds)
+        abort();
+
+    for(int i = 0; i < i_bodies.size(); ++i){
+        Body *original = i_bodies[i];
+        Body *b = new (bodies + i*stride) Body(*original, new (colds + i) BodyCold(*original->cold));
+        b->id = i;
+        count++;
+        delete original;
+        i_bodies[i] = b;
+    }
+}
+
+void BodyStore::clear()
+{
+    for(int i = 0; i < count; ++i){
+        // the cold record is the store's, not the body's to delete
+        Body *b = (*this)[i];
+        b->cold = NULL;
+        b->~Body();
+        colds[i].~BodyCold();
+    }
+    free(bodies);
+    free(colds);
+    bodies = NULL;
+    colds = NULL;
+    count = 0;
+}
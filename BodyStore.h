@@ -0,0 +1,56 @@
+/**
+ * @file BodyStore.h
+ * @brief Contiguous storage of the bodies of a System, indexed by Body::id.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <vector>
+#include "Body.h"
+
+/**
+ * Owns the bodies of a System in one cache line aligned block, in the order
+ * of their ids.
+ *
+ * The scenes build their bodies one new at a time, which leaves them spread
+ * over the heap between the meshes and materials allocated with them. Every
+ * pass walks the bodies, so the store moves them next to each other when the
+ * System takes them over. A body keeps its place for the life of the store,
+ * so Body pointers and ids stay valid however the System reorders bVector.
+ * The bodies are padded to an odd number of cache lines. Their cold records
+ * are kept in a block of their own, in the same order.
+ */
+class BodyStore
+{
+public:
+    BodyStore();
+    ~BodyStore();
+
+    /**
+     * Moves the bodies into the store and frees the originals. The pointers
+     * in bodies are updated to the stored bodies and their ids set to their
+     * index. Any bodies already stored are destroyed first.
+     */
+    void adopt(std::vector<Body*> &bodies);
+
+    /**
+     * Destroys the stored bodies.
+     */
+    void clear();
+
+    int size() const { return count; }
+    Body* operator[](int id) { return (Body *) (bodies + id*stride); }
+    const Body* operator[](int id) const { return (const Body *) (bodies + id*stride); }
+
+private:
+    BodyStore(const BodyStore&);
+    BodyStore& operator=(const BodyStore&);
+
+    char *bodies;
+    BodyCold *colds;
+    int count;
+    // bytes from one body to the next, an odd number of cache lines
+    size_t stride;
+};
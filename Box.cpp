@@ -14,29 +14,28 @@
 #include <fstream>
 #include <sstream>
 
-Box::Box(Color3 color)
+Box::Box()
 {
     mesh = new BoxMesh();
     material = new Material();
     material->ambient = Color3(1.0, 1.0, 1.0);
-    material->diffuse = color;
     material->specular = Color3::White;
 }
 
 Box::~Box() { delete mesh; delete material; }
 
-void Box::render() const
+void Box::render(const Color3 &color) const
 {
     if ( !mesh )
         return;
     if ( material )
-        material->set_gl_state();
+        material->set_gl_state(color);
     glutSolidCube(1.0);
     if ( material )
         material->reset_gl_state();
 }
 
-void Box::get_Iinv(Matrix3& Iinv, Vec3 size, double inv_mass)
+void Box::get_Iinv(Matrix3& Iinv, Vec3 size, real_t inv_mass) const
 {
     Vec3 c1, c2, c3;
     c1 = Vec3(12.0*inv_mass / (size[1]*size[1] + size[2]*size[2]), 0.0, 0.0);
@@ -72,9 +71,9 @@ Vec3 Box::GetSupportPoint(const Vec3& local_normal) const
 	////////////////////////
 	// Exact intersection //
 	////////////////////////
-	// double x_abs = fabs(local_normal[0]);
-	// double y_abs = fabs(local_normal[1]);
-	// double z_abs = fabs(local_normal[2]);
+	// real_t x_abs = fabs(local_normal[0]);
+	// real_t y_abs = fabs(local_normal[1]);
+	// real_t z_abs = fabs(local_normal[2]);
 	// int intersection_axis_index = 2;
 	// if(x_abs > y_abs)
 	// {
@@ -154,7 +153,7 @@ bool Box::intersection_test(Vec3 p, Vec3 &normal) const{
 		if(p[1] < .5 && p[1] > -.5){
 			if(p[2] < .5 && p[2] > -.5){
 				// find the closest normal
-				double abs_x, abs_y, abs_z;
+				real_t abs_x, abs_y, abs_z;
 				abs_x = fabs(p[0]);
 				abs_y = fabs(p[1]);
 				abs_z = fabs(p[2]);
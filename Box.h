@@ -4,12 +4,13 @@
 
 class Box : public Model{
 public:
-    Box(Color3);
+    Box();
     virtual ~Box();
 
-    virtual void render() const;
-    virtual void get_Iinv(Matrix3& Iinv, Vec3 size, double inv_mass);
+    virtual void render(const Color3 &color) const;
+    virtual void get_Iinv(Matrix3& Iinv, Vec3 size, real_t inv_mass) const;
     virtual int num_vertices() const;
+    virtual ShapeType shape_type() const { return SHAPE_BOX; }
 #if USE_XENOCOLLIDE
     virtual Vec3 GetSupportPoint(const Vec3& normal) const;
 #else
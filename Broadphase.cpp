@@ -0,0 +1,196 @@
+/**
+ * @file Broadphase.cpp
+ * @brief Broadphase culling of body pairs before the narrowphase.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "Broadphase.h"
+#include "Body.h"
+#include <algorithm>
+
+void get_fat_aabb(const Body *b, real_t dt, AABB &box)
+{
+    // a body moved back to x and re-integrated after an impulse can end up
+    // on the other side of its predicted position, so allow twice the step
+    b->get_aabb(box, BROADPHASE_MARGIN + 2.0*norm(b->Velocity)*dt);
+}
+
+SweepAndPrune::SweepAndPrune() : num_proxies(0)
+{
+}
+
+SweepAndPrune::~SweepAndPrune()
+{
+    clear();
+}
+
+void SweepAndPrune::clear()
+{
+    for(int axis = 0; axis < 3; ++axis)
+        axes[axis].clear();
+    boxes.clear();
+    proxies.clear();
+    overlapping.clear();
+    num_proxies = 0;
+}
+
+/**
+ * Orders endpoints by value. On ties a min endpoint comes before a max
+ * endpoint so that touching boxes are reported as overlapping.
+ **/
+bool SweepAndPrune::less(const Endpoint &a, const Endpoint &b)
+{
+    if(a.value != b.value)
+        return a.value < b.value;
+    return !a.is_max && b.is_max;
+}
+
+void SweepAndPrune::add_pair(int id1, int id2)
+{
+    if(id1 > id2)
+        std::swap(id1, id2);
+    overlapping.insert(std::make_pair(id1, id2));
+}
+
+void SweepAndPrune::remove_pair(int id1, int id2)
+{
+    if(id1 > id2)
+        std::swap(id1, id2);
+    overlapping.erase(std::make_pair(id1, id2));
+}
+
+void SweepAndPrune::update(const std::vector<Body*> &bodies, real_t dt)
+{
+    bool changed = (int) bodies.size() != num_proxies;
+    for(int i = 0; !changed && i < bodies.size(); ++i){
+        int id = bodies[i]->id;
+        changed = id < 0 || id >= proxies.size() || proxies[id] != bodies[i];
+    }
+
+    if(changed){
+        rebuild(bodies);
+    }
+    else{
+        // refit the boxes
+        for(int i = 0; i < bodies.size(); ++i){
+            get_fat_aabb(bodies[i], dt, boxes[bodies[i]->id]);
+        }
+
+        // update the endpoints and restore the ordering
+        for(int axis = 0; axis < 3; ++axis){
+            std::vector<Endpoint> &ep = axes[axis];
+            for(int i = 0; i < ep.size(); ++i){
+                const AABB &box = boxes[ep[i].id];
+                ep[i].value = ep[i].is_max ? box.hi[axis] : box.lo[axis];
+            }
+            sort_axis(axis);
+        }
+    }
+}
+
+void SweepAndPrune::get_pairs(std::vector<BodyPair> &pairs)
+{
+    pairs.clear();
+    std::set<std::pair<int, int> >::const_iterator it;
+    for(it = overlapping.begin(); it != overlapping.end(); ++it)
+        pairs.push_back(BodyPair(proxies[it->first], proxies[it->second]));
+}
+
+void SweepAndPrune::query(const AABB &box, std::vector<Body*> &bodies) const
+{
+    const std::vector<Endpoint> &ep = axes[0];
+    for(int i = 0; i < ep.size() && ep[i].value <= box.hi[0]; ++i){
+        if(!ep[i].is_max && overlaps(boxes[ep[i].id], box))
+            bodies.push_back(proxies[ep[i].id]);
+    }
+}
+
+/**
+ * Insertion sort of one axis. Every swap of a min endpoint past a max
+ * endpoint means that pair of boxes changed their overlap on this axis.
+ **/
+void SweepAndPrune::sort_axis(int axis)
+{
+    std::vector<Endpoint> &ep = axes[axis];
+    for(int i = 1; i < ep.size(); ++i){
+        Endpoint key = ep[i];
+        int j = i - 1;
+        while(j >= 0 && less(key, ep[j])){
+            const Endpoint &other = ep[j];
+            if(key.id != other.id){
+                if(!key.is_max && other.is_max){
+                    // the boxes started overlapping on this axis
+                    if(overlaps(boxes[key.id], boxes[other.id]))
+                        add_pair(key.id, other.id);
+                }
+                else if(key.is_max && !other.is_max){
+                    // the boxes stopped overlapping on this axis
+                    remove_pair(key.id, other.id);
+                }
+            }
+            ep[j + 1] = ep[j];
+            --j;
+        }
+        ep[j + 1] = key;
+    }
+}
+
+/**
+ * Builds the sorted endpoint lists from scratch and finds the
+ * overlapping pairs with a single sweep along the x axis.
+ **/
+void SweepAndPrune::rebuild(const std::vector<Body*> &bodies)
+{
+    clear();
+
+    int max_id = -1;
+    for(int i = 0; i < bodies.size(); ++i)
+        max_id = std::max(max_id, bodies[i]->id);
+    boxes.resize(max_id + 1);
+    proxies.resize(max_id + 1, NULL);
+    num_proxies = bodies.size();
+
+    for(int i = 0; i < bodies.size(); ++i){
+        Body *b = bodies[i];
+        proxies[b->id] = b;
+        // the velocity is not known to be coherent on a rebuild, so only pad by the margin
+        b->get_aabb(boxes[b->id], BROADPHASE_MARGIN);
+
+        for(int axis = 0; axis < 3; ++axis){
+            Endpoint e;
+            e.id = b->id;
+            e.is_max = false;
+            e.value = boxes[b->id].lo[axis];
+            axes[axis].push_back(e);
+            e.is_max = true;
+            e.value = boxes[b->id].hi[axis];
+            axes[axis].push_back(e);
+        }
+    }
+
+    for(int axis = 0; axis < 3; ++axis)
+        std::sort(axes[axis].begin(), axes[axis].end(), less);
+
+    // sweep along x keeping a list of the boxes that are currently open
+    std::vector<int> active;
+    const std::vector<Endpoint> &ep = axes[0];
+    for(int i = 0; i < ep.size(); ++i){
+        if(!ep[i].is_max){
+            for(int k = 0; k < active.size(); ++k){
+                if(overlaps(boxes[ep[i].id], boxes[active[k]]))
+                    add_pair(ep[i].id, active[k]);
+            }
+            active.push_back(ep[i].id);
+        }
+        else{
+            for(int k = 0; k < active.size(); ++k){
+                if(active[k] == ep[i].id){
+                    active[k] = active.back();
+                    active.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+}
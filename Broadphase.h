@@ -0,0 +1,109 @@
+/**
+ * @file Broadphase.h
+ * @brief Broadphase culling of body pairs before the narrowphase.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <vector>
+#include <set>
+#include <utility>
+#include "AABB.h"
+
+class Body;
+
+// extra padding added to every box so that small motions within a frame
+// do not immediately change the set of overlapping pairs
+#define BROADPHASE_MARGIN 0.05
+
+typedef std::pair<Body*, Body*> BodyPair;
+
+/**
+ * Computes the box of a body grown by the margin and by how far it could move in dt.
+ */
+void get_fat_aabb(const Body *b, real_t dt, AABB &box);
+
+/**
+ * Interface for structures that cull the pairs of bodies that can not be touching.
+ *
+ * Bodies are tracked by their Body::id, so the order of the body list
+ * passed to update() does not matter.
+ */
+class Broadphase
+{
+public:
+    Broadphase() { }
+    virtual ~Broadphase() { }
+
+    /**
+     * Refits the boxes of the given bodies to their current state. The boxes
+     * are grown by the distance each body could travel in dt. If the set of
+     * bodies changed the structure is rebuilt from scratch.
+     */
+    virtual void update(const std::vector<Body*> &bodies, real_t dt) = 0;
+
+    /**
+     * Finds the pairs of bodies whose boxes overlapped at the last update.
+     * @param pairs[out] Cleared and filled with the overlapping pairs.
+     */
+    virtual void get_pairs(std::vector<BodyPair> &pairs) = 0;
+
+    /**
+     * Finds the bodies whose boxes overlap the given box.
+     * @param bodies[out] The overlapping bodies are appended to this list.
+     */
+    virtual void query(const AABB &box, std::vector<Body*> &bodies) const = 0;
+
+    /**
+     * Drops all tracked bodies. The next update will rebuild.
+     */
+    virtual void clear() = 0;
+};
+
+/**
+ * Incremental sweep and prune over the bodies' world space boxes.
+ *
+ * The endpoints of every box are kept sorted along each axis between
+ * frames. Bodies only move a little each step so re-sorting with an
+ * insertion sort is close to linear, and the set of overlapping pairs
+ * is updated from the endpoint swaps instead of being recomputed.
+ */
+class SweepAndPrune : public Broadphase
+{
+public:
+    SweepAndPrune();
+    virtual ~SweepAndPrune();
+
+    virtual void update(const std::vector<Body*> &bodies, real_t dt);
+    virtual void get_pairs(std::vector<BodyPair> &pairs);
+    /**
+     * Walks the x axis up to the end of the box, so this is linear in the
+     * number of bodies to the left of it.
+     */
+    virtual void query(const AABB &box, std::vector<Body*> &bodies) const;
+    virtual void clear();
+
+private:
+    struct Endpoint
+    {
+        real_t value;
+        int id;
+        bool is_max;
+    };
+
+    void rebuild(const std::vector<Body*> &bodies);
+    void sort_axis(int axis);
+    void add_pair(int id1, int id2);
+    void remove_pair(int id1, int id2);
+    static bool less(const Endpoint &a, const Endpoint &b);
+
+    std::vector<Endpoint> axes[3];
+    // indexed by body id
+    std::vector<AABB> boxes;
+    std::vector<Body*> proxies;
+    int num_proxies;
+    // overlapping pairs as (smaller id, larger id)
+    std::set<std::pair<int, int> > overlapping;
+};
@@ -0,0 +1,396 @@
+/**
+ * @file Collide.cpp
+ * @brief Narrowphase tests chosen by the shapes of the two bodies.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "Collide.h"
+#include "Body.h"
+#include <math.h>
+#include <algorithm>
+
+// An axis only replaces the best one found so far if it separates the boxes
+// by clearly more, so a box resting on a face does not flip between axes of
+// nearly the same depth from one frame to the next.
+#define AXIS_REL_TOLERANCE 0.95
+#define AXIS_ABS_TOLERANCE 0.01
+
+// cross products of edges closer to parallel than this are not used as axes
+#define PARALLEL_EPSILON 1e-6
+
+// rows are the shape of the first body, columns the shape of the second,
+// NULL entries fall back to the swapped entry and then to collide_convex
+static CollideFunc collide_table[NUM_SHAPE_TYPES][NUM_SHAPE_TYPES] = {
+    //  SHAPE_BOX         SHAPE_CONVEX  SHAPE_PLANE
+    {   collide_box_box,  NULL,         collide_box_plane     },  // SHAPE_BOX
+    {   NULL,             NULL,         collide_convex_plane  },  // SHAPE_CONVEX
+    {   NULL,             NULL,         NULL                  },  // SHAPE_PLANE
+};
+
+void set_collide_func(ShapeType a, ShapeType b, CollideFunc func)
+{
+    collide_table[a][b] = func;
+}
+
+bool collide(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache)
+{
+    ShapeType a = b1->shape;
+    ShapeType b = b2->shape;
+
+    if(collide_table[a][b])
+        return collide_table[a][b](b1, b2, contacts, cache);
+
+    if(collide_table[b][a])
+    {
+        if(!collide_table[b][a](b2, b1, contacts, cache))
+            return false;
+        for(int i = 0; i < contacts.num_points; ++i)
+            std::swap(contacts.p1[i], contacts.p2[i]);
+        contacts.normal = -contacts.normal;
+        return true;
+    }
+
+    return collide_convex(b1, b2, contacts, cache);
+}
+
+bool collide_convex(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache)
+{
+#if USE_XENOCOLLIDE
+    Vec3 normal;
+    if(!Body::intersection_test(b1, b2, contacts.p1[0], contacts.p2[0], normal, cache))
+        return false;
+    // The intersection test returns a normal relative to b2.
+    contacts.normal = -normal;
+#else
+    Vec3 p;
+    if(!b1->intersection_test(b2, p, contacts.normal))
+        return false;
+    contacts.p1[0] = p;
+    contacts.p2[0] = p;
+#endif
+    contacts.num_points = 1;
+    return true;
+}
+
+/**
+ * A box in world space, taken from the body's cached rotation matrix.
+ **/
+struct OBB
+{
+    Vec3 center;
+    Vec3 axis[3];
+    real_t half[3];
+};
+
+static void get_obb(const Body *b, OBB &box)
+{
+    box.center = b->Position;
+    for(int k = 0; k < 3; ++k){
+        // the kth column of R is the body's kth axis
+        box.axis[k] = Vec3(b->R._m[k][0], b->R._m[k][1], b->R._m[k][2]);
+        box.half[k] = 0.5*b->size[k];
+    }
+}
+
+/**
+ * returns half the width of the box along a unit axis
+ **/
+static real_t project(const OBB &box, const Vec3 &axis)
+{
+    return box.half[0]*fabs(box.axis[0]*axis) +
+           box.half[1]*fabs(box.axis[1]*axis) +
+           box.half[2]*fabs(box.axis[2]*axis);
+}
+
+/**
+ * Remembers the axis that separated the boxes, in the frame of the first body.
+ * It is stored pointing from the second box to the first like XenoCollide's directions.
+ **/
+static void cache_axis(MPRCache *cache, const Body *b1, const Vec3 &axis, bool separating)
+{
+    if(cache)
+    {
+        cache->local_dir = conjugate(b1->Orientation)*(-axis);
+        cache->separating = separating;
+        cache->valid = true;
+    }
+}
+
+/**
+ * Clips a polygon to the half space p*normal <= offset.
+ * Returns the number of vertices written to out.
+ **/
+static int clip_polygon(const Vec3 *in, int num_in, const Vec3 &normal, real_t offset, Vec3 *out)
+{
+    int num_out = 0;
+    for(int i = 0; i < num_in; ++i){
+        const Vec3 &a = in[i];
+        const Vec3 &b = in[(i + 1) % num_in];
+        real_t da = a*normal - offset;
+        real_t db = b*normal - offset;
+        if(da <= 0.0)
+            out[num_out++] = a;
+        if((da < 0.0 && db > 0.0) || (da > 0.0 && db < 0.0))
+            out[num_out++] = a + (b - a)*(da / (da - db));
+    }
+    return num_out;
+}
+
+/**
+ * Finds the contacts of a box resting a face on the reference box. face is the
+ * axis of the reference box and ref_normal points out of that face toward the
+ * incident box. The points are returned as (point on reference, point on incident).
+ **/
+static int clip_face_contacts(const OBB &ref, int face, const Vec3 &ref_normal, const OBB &inc,
+                              Vec3 *ref_points, Vec3 *inc_points)
+{
+    // the face of the incident box that points most against the reference face
+    int k = 0;
+    real_t best = 0.0;
+    for(int n = 0; n < 3; ++n){
+        real_t d = fabs(inc.axis[n]*ref_normal);
+        if(d > best){
+            best = d;
+            k = n;
+        }
+    }
+    Vec3 inc_normal = inc.axis[k]*ref_normal > 0.0 ? -inc.axis[k] : inc.axis[k];
+    Vec3 inc_center = inc.center + inc_normal*inc.half[k];
+    Vec3 u = inc.axis[(k + 1) % 3]*inc.half[(k + 1) % 3];
+    Vec3 v = inc.axis[(k + 2) % 3]*inc.half[(k + 2) % 3];
+
+    Vec3 poly[MAX_CONTACT_POINTS], clipped[MAX_CONTACT_POINTS];
+    poly[0] = inc_center + u + v;
+    poly[1] = inc_center - u + v;
+    poly[2] = inc_center - u - v;
+    poly[3] = inc_center + u - v;
+    int num = 4;
+
+    // clip against the four sides of the reference face
+    for(int n = 1; n < 3 && num > 0; ++n){
+        const Vec3 &side = ref.axis[(face + n) % 3];
+        real_t offset = side*ref.center;
+        real_t half = ref.half[(face + n) % 3];
+        num = clip_polygon(poly, num, side, offset + half, clipped);
+        num = clip_polygon(clipped, num, -side, -offset + half, poly);
+    }
+
+    // keep the points below the reference face and project them onto it
+    real_t face_offset = ref_normal*ref.center + ref.half[face];
+    int num_points = 0;
+    for(int n = 0; n < num; ++n){
+        real_t depth = face_offset - ref_normal*poly[n];
+        if(depth >= 0.0){
+            inc_points[num_points] = poly[n];
+            ref_points[num_points] = poly[n] + ref_normal*depth;
+            num_points++;
+        }
+    }
+    return num_points;
+}
+
+bool collide_box_box(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache)
+{
+    OBB A, B;
+    get_obb(b1, A);
+    get_obb(b2, B);
+    Vec3 d = B.center - A.center;
+
+    // an axis which separated the boxes last time usually still does
+    if(cache && cache->valid && cache->separating)
+    {
+        Vec3 axis = b1->Orientation*cache->local_dir;
+        if(fabs(axis*d) > project(A, axis) + project(B, axis))
+            return false;
+    }
+
+    // C[i][j] is the cosine between the ith axis of A and the jth axis of B.
+    // Absolute values are padded so edges that are nearly parallel can not
+    // produce a zero length axis that looks separating.
+    real_t C[3][3], abs_C[3][3], da[3], db[3];
+    for(int i = 0; i < 3; ++i){
+        for(int j = 0; j < 3; ++j){
+            C[i][j] = A.axis[i]*B.axis[j];
+            abs_C[i][j] = fabs(C[i][j]) + PARALLEL_EPSILON;
+        }
+        da[i] = A.axis[i]*d;
+        db[i] = B.axis[i]*d;
+    }
+
+    // face axes of A
+    int face_axis = -1;
+    real_t face_sep = -HUGE_VAL;
+    for(int i = 0; i < 3; ++i){
+        real_t sep = fabs(da[i]) - (A.half[i] + B.half[0]*abs_C[i][0] + B.half[1]*abs_C[i][1] + B.half[2]*abs_C[i][2]);
+        if(sep > 0.0)
+        {
+            cache_axis(cache, b1, A.axis[i], true);
+            return false;
+        }
+        if(sep > face_sep)
+        {
+            face_sep = sep;
+            face_axis = i;
+        }
+    }
+
+    // face axes of B
+    for(int j = 0; j < 3; ++j){
+        real_t sep = fabs(db[j]) - (A.half[0]*abs_C[0][j] + A.half[1]*abs_C[1][j] + A.half[2]*abs_C[2][j] + B.half[j]);
+        if(sep > 0.0)
+        {
+            cache_axis(cache, b1, B.axis[j], true);
+            return false;
+        }
+        if(sep > AXIS_REL_TOLERANCE*face_sep + AXIS_ABS_TOLERANCE)
+        {
+            face_sep = sep;
+            face_axis = 3 + j;
+        }
+    }
+
+    // cross products of an edge of A and an edge of B
+    int edge_i = -1, edge_j = -1;
+    real_t edge_sep = -HUGE_VAL;
+    Vec3 edge_normal;
+    for(int i = 0; i < 3; ++i){
+        int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+        for(int j = 0; j < 3; ++j){
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            // A_i x B_j written in the frame of A
+            real_t length = sqrt(C[i1][j]*C[i1][j] + C[i2][j]*C[i2][j]);
+            if(length < PARALLEL_EPSILON)
+                continue;
+            real_t dist = C[i1][j]*da[i2] - C[i2][j]*da[i1];
+            real_t rA = A.half[i1]*abs_C[i2][j] + A.half[i2]*abs_C[i1][j];
+            real_t rB = B.half[j1]*abs_C[i][j2] + B.half[j2]*abs_C[i][j1];
+            real_t sep = (fabs(dist) - rA - rB) / length;
+            if(sep > 0.0)
+            {
+                cache_axis(cache, b1, cross(A.axis[i], B.axis[j]) / length, true);
+                return false;
+            }
+            if(sep > edge_sep)
+            {
+                edge_sep = sep;
+                edge_i = i;
+                edge_j = j;
+                edge_normal = cross(A.axis[i], B.axis[j]) / length;
+            }
+        }
+    }
+
+    contacts.num_points = 0;
+    if(edge_i >= 0 && edge_sep > AXIS_REL_TOLERANCE*face_sep + AXIS_ABS_TOLERANCE)
+    {
+        // two edges cross, the contact is between their closest points
+        Vec3 n = edge_normal*d < 0.0 ? -edge_normal : edge_normal;
+        Vec3 pA = A.center, pB = B.center;
+        for(int k = 0; k < 3; ++k){
+            if(k != edge_i)
+                pA += A.axis[k]*(A.axis[k]*n > 0.0 ? A.half[k] : -A.half[k]);
+            if(k != edge_j)
+                pB += B.axis[k]*(B.axis[k]*n > 0.0 ? -B.half[k] : B.half[k]);
+        }
+        const Vec3 &dA = A.axis[edge_i];
+        const Vec3 &dB = B.axis[edge_j];
+        Vec3 r = pA - pB;
+        real_t b = dA*dB;
+        real_t denom = 1.0 - b*b;
+        real_t s = denom > PARALLEL_EPSILON ? (b*(dB*r) - dA*r) / denom : 0.0;
+        s = std::max(-A.half[edge_i], std::min(A.half[edge_i], s));
+        real_t t = std::max(-B.half[edge_j], std::min(B.half[edge_j], dB*(r + dA*s)));
+
+        contacts.normal = n;
+        contacts.p1[0] = pA + dA*s;
+        contacts.p2[0] = pB + dB*t;
+        contacts.num_points = 1;
+    }
+    else if(face_axis < 3)
+    {
+        Vec3 n = da[face_axis] < 0.0 ? -A.axis[face_axis] : A.axis[face_axis];
+        contacts.normal = n;
+        contacts.num_points = clip_face_contacts(A, face_axis, n, B, contacts.p1, contacts.p2);
+    }
+    else
+    {
+        Vec3 n = db[face_axis - 3] < 0.0 ? -B.axis[face_axis - 3] : B.axis[face_axis - 3];
+        contacts.normal = n;
+        contacts.num_points = clip_face_contacts(B, face_axis - 3, -n, A, contacts.p2, contacts.p1);
+    }
+
+    if(contacts.num_points == 0)
+    { // the clipping lost every point to round off, let the general test find one
+        return collide_convex(b1, b2, contacts, cache);
+    }
+
+    cache_axis(cache, b1, contacts.normal, false);
+    return true;
+}
+
+/**
+ * The outward normal of a plane and its offset along it, so the points p on
+ * the plane have p*normal == offset.
+ **/
+static void get_plane(const Body *plane, Vec3 &normal, real_t &offset)
+{
+    // the plane's normal is its body's y axis, the second column of R
+    normal = Vec3(plane->R._m[1][0], plane->R._m[1][1], plane->R._m[1][2]);
+    offset = plane->Position*normal;
+}
+
+bool collide_box_plane(Body *box, Body *plane, ContactSet &contacts, MPRCache *cache)
+{
+    Vec3 normal;
+    real_t offset;
+    get_plane(plane, normal, offset);
+
+    OBB A;
+    get_obb(box, A);
+    real_t center_dist = A.center*normal - offset;
+    if(center_dist > project(A, normal))
+        return false;
+
+    contacts.num_points = 0;
+    for(int c = 0; c < 8; ++c){
+        Vec3 corner = A.center;
+        for(int k = 0; k < 3; ++k)
+            corner += ((c >> k) & 1 ? A.half[k] : -A.half[k])*A.axis[k];
+        real_t dist = corner*normal - offset;
+        if(dist < 0.0)
+        {
+            contacts.p1[contacts.num_points] = corner;
+            contacts.p2[contacts.num_points] = corner - dist*normal;
+            contacts.num_points++;
+        }
+    }
+    contacts.normal = -normal;
+    return contacts.num_points > 0;
+}
+
+bool collide_convex_plane(Body *b, Body *plane, ContactSet &contacts, MPRCache *cache)
+{
+#if USE_XENOCOLLIDE
+    Vec3 normal;
+    real_t offset;
+    get_plane(plane, normal, offset);
+
+    if(b->Position*normal - offset > b->radius)
+        return false;
+
+    Vec3 deepest = b->cold->model->GetSupportPoint(conjugate(b->Orientation)*(-normal));
+    b->TransformBodyToWorld(deepest);
+    real_t dist = deepest*normal - offset;
+    if(dist >= 0.0)
+        return false;
+
+    contacts.p1[0] = deepest;
+    contacts.p2[0] = deepest - dist*normal;
+    contacts.normal = -normal;
+    contacts.num_points = 1;
+    return true;
+#else
+    return collide_convex(b, plane, contacts, cache);
+#endif
+}
@@ -0,0 +1,74 @@
+/**
+ * @file Collide.h
+ * @brief Narrowphase tests chosen by the shapes of the two bodies.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <gfx/vec3.h>
+#include "Model.h"
+
+class Body;
+struct MPRCache;
+
+// most contact points a single test can return, a box face clipped by another box gives 8
+#define MAX_CONTACT_POINTS 8
+
+/**
+ * The contacts found between two bodies. p1[i] and p2[i] are the world
+ * positions of the ith contact on each body and the normal points from
+ * the first body to the second.
+ */
+struct ContactSet
+{
+    Vec3 normal;
+    Vec3 p1[MAX_CONTACT_POINTS];
+    Vec3 p2[MAX_CONTACT_POINTS];
+    int num_points;
+
+    ContactSet() : num_points(0) {}
+};
+
+/**
+ * A narrowphase test between a body with shape a and a body with shape b.
+ * Returns true and fills contacts if the bodies intersect. The cache, which
+ * may be NULL, holds the search direction left by the last test of the pair.
+ */
+typedef bool (*CollideFunc)(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache);
+
+/**
+ * Tests two bodies for intersection with the test registered for their shapes.
+ * Pairs without a registered test fall back to XenoCollide.
+ */
+bool collide(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache = NULL);
+
+/**
+ * Registers the test used when the first body has shape a and the second shape b.
+ * The swapped pair uses the same test with the bodies and the results flipped.
+ */
+void set_collide_func(ShapeType a, ShapeType b, CollideFunc func);
+
+/**
+ * XenoCollide test between any two convex shapes. Returns a single contact.
+ */
+bool collide_convex(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache);
+
+/**
+ * Separating axis test between two oriented boxes. Returns every corner of the
+ * overlap of the touching faces, or the closest points of two crossing edges.
+ */
+bool collide_box_box(Body *b1, Body *b2, ContactSet &contacts, MPRCache *cache);
+
+/**
+ * Tests a box against a plane. Returns every corner of the box below the
+ * plane, with the normal of the plane as the contact normal.
+ */
+bool collide_box_plane(Body *box, Body *plane, ContactSet &contacts, MPRCache *cache);
+
+/**
+ * Tests any convex shape against a plane. Returns the single deepest point
+ * of the shape, found from its support point along the plane's normal.
+ */
+bool collide_convex_plane(Body *b, Body *plane, ContactSet &contacts, MPRCache *cache);
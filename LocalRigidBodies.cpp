@@ -8,6 +8,9 @@
 #include "System.h"
 #include "integrator.h"
 #include "Box.h"
+#include "Plane.h"
+#include "ShapeRegistry.h"
+#include "Timestep.h"
 #include "csapp.h"
 
 #include <vector>
@@ -17,9 +20,6 @@
 #include <time.h>
 
 /* macros */
-#define MAX_COLLISIONS 5
-#define MAX_CONTACTS 5
-#define MAX_SHOCK_PROP 1
 #define rot_ang PI/5.0
 
 /* global variables */
@@ -43,7 +43,7 @@ static int hmx, hmy;
 // flag for whether the mouse has already been registered as being down
 static bool clicked;
 
-static RBIntegrator* integrator;
+static RBIntegratorType integrator_type = RB_EULER;
 static System* sys = NULL;
 
 // camera data
@@ -54,12 +54,13 @@ static GLfloat light_position[4] = { -100.0, 1000, -100.0, 1.0 };
 // networking data
 static int start_time, reset_time;
 
-// globals for tarjan's algorithm
-extern std::vector<Body*> top_sorted;
-extern std::stack<Body*> S;
-extern int SCC_num;
-
-static double *prev_pos, *prev_vel, *y_vel;
+// runs the steps at dt whatever the timer does
+#define MAX_SUBSTEPS 4
+static FixedTimestep *timestep;
+static int prev_tick_time;
+static int num_steps;
+// pose of each body before the last step, indexed by Body::id
+static std::vector<BodyInfo> last_pose;
 
 /*********************************************************************
 * free/clear/allocate simulation data
@@ -69,10 +70,7 @@ static void free_data ( void )
 {
 	delete sys;
 	bVector.clear();
-	delete integrator;
-	delete[] prev_pos;
-	delete[] prev_vel;
-	delete[] y_vel;
+	delete timestep;
 }
 
 /*********************************************************************
@@ -87,9 +85,9 @@ static void init_slide()
 	const Vec3 z_offset(0.0, 0.0, dist);
 
 	// floor
-	bVector.push_back(new Body(center, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), new Box(Color3(1.0, 1.0, .5)), Vec3(20, 20, 20), 1.0, .7, 0.0));
+	bVector.push_back(new Body(center, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), ShapeRegistry::get(SHAPE_BOX), Color3(1.0, 1.0, .5), Vec3(20, 20, 20), 1.0, .7, 0.0));
 
-	bVector.push_back(new Body(center + (10*(sin(rot_ang) + cos(rot_ang)) + .5*(cos(rot_ang) - sin(rot_ang)))*y_offset + (10*(cos(rot_ang) - sin(rot_ang)) - .5*(sin(rot_ang) + cos(rot_ang)))*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 1.0, 1.0));
+	bVector.push_back(new Body(center + (10*(sin(rot_ang) + cos(rot_ang)) + .5*(cos(rot_ang) - sin(rot_ang)))*y_offset + (10*(cos(rot_ang) - sin(rot_ang)) - .5*(sin(rot_ang) + cos(rot_ang)))*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 1.0, 1.0));
 }
 
 static void init_combo()
@@ -104,52 +102,52 @@ static void init_combo()
 	light_position[1] = 2000.0;
 
 	// floor
-	bVector.push_back(new Body(center - 110*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(200, 200, 200), .4, 0.5, 0.0));
-	bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset + (3 - 4.75/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.7, 0.0, .0)), Vec3(10, .5, 10), .4, .5, 0.0));
-	bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset - (10 + 3.25/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), -PI/4.0), new Box(Color3(0.0, 0.2, .7)), Vec3(10, .5, 10), .4, .5, 0.0));
+	bVector.push_back(new Body(center - 10*y_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(200, 0, 200), .4, 0.5, 0.0));
+	bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset + (3 - 4.75/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.7, 0.0, .0), Vec3(10, .5, 10), .4, .5, 0.0));
+	bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset - (10 + 3.25/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), -PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(0.0, 0.2, .7), Vec3(10, .5, 10), .4, .5, 0.0));
 	
-	bVector.push_back(new Body(center - (-second_wave_offset + (3 + 5.0*sqrt(2) - 14.75/sqrt(2)))*y_offset + (3 - 4.75/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.7, 0.0, .0)), Vec3(10, .5, 10), .4, .5, 0.0));
-	bVector.push_back(new Body(center - (-second_wave_offset + (3 + 5.0*sqrt(2) - 14.75/sqrt(2)))*y_offset - (10 + 3.25/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), -PI/4.0), new Box(Color3(0.0, 0.2, .7)), Vec3(10, .5, 10), .4, .5, 0.0));
+	bVector.push_back(new Body(center - (-second_wave_offset + (3 + 5.0*sqrt(2) - 14.75/sqrt(2)))*y_offset + (3 - 4.75/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.7, 0.0, .0), Vec3(10, .5, 10), .4, .5, 0.0));
+	bVector.push_back(new Body(center - (-second_wave_offset + (3 + 5.0*sqrt(2) - 14.75/sqrt(2)))*y_offset - (10 + 3.25/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), -PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(0.0, 0.2, .7), Vec3(10, .5, 10), .4, .5, 0.0));
 	// right
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .7)*y_offset - (.5*sqrt(2) - 1.7)*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1.7, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (.5*sqrt(2) - 1.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (.5*sqrt(2) - 2)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7 + 3.5)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1.7, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .7)*y_offset - (.5*sqrt(2) - 1.7)*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1.7, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (.5*sqrt(2) - 1.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (.5*sqrt(2) - 2)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7 + 3.5)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1.7, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
 	
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .7))*y_offset - (.5*sqrt(2) - 1.7)*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.7))*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1.7, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .5))*y_offset - (.5*sqrt(2) - 1.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1))*y_offset - (.5*sqrt(2) - 2)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2 + 3.5))*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.7 + 3.5))*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1.7, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2 + 3.5))*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .7))*y_offset - (.5*sqrt(2) - 1.7)*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.7))*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1.7, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .5))*y_offset - (.5*sqrt(2) - 1.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1))*y_offset - (.5*sqrt(2) - 2)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2 + 3.5))*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.7 + 3.5))*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1.7, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2 + 3.5))*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
 	//left
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) + 10)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1.7, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (3.5*sqrt(2) - 4.5 + 13)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) - 3 + 13)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5 + 3.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8 + 3.5)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1.7, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1 + 3.5)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) + 10)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1.7, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (3.5*sqrt(2) - 4.5 + 13)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) - 3 + 13)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5 + 3.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8 + 3.5)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1.7, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1 + 3.5)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
 	
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (3.5*sqrt(2) + 10)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.5))*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .8))*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1.7, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .5))*y_offset - (3.5*sqrt(2) - 4.5 + 13)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (3.5*sqrt(2) - 3 + 13)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1))*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.5 + 3.5))*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .8 + 3.5))*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1.7, 1), .7, .5, 1.0));
-	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1 + 3.5))*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (3.5*sqrt(2) + 10)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.5))*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .8))*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1.7, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .5))*y_offset - (3.5*sqrt(2) - 4.5 + 13)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 2))*y_offset - (3.5*sqrt(2) - 3 + 13)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1))*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1.5 + 3.5))*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + .8 + 3.5))*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1.7, 1), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (second_wave_offset + (5*(sqrt(2) - 1) + 1 + 3.5))*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
 }
 
 static void init_single_box()
@@ -161,9 +159,9 @@ static void init_single_box()
 	const Vec3 z_offset(0.0, 0.0, dist);
 
 	// floor
-	bVector.push_back(new Body(center - 0.5*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 1, 100), 0.5, 0.5, 0));
+	bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), 0.5, 0.5, 0));
 
-	bVector.push_back(new Body(center + 5*y_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
+	bVector.push_back(new Body(center + 5*y_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
 }
 
 static void init_small_pile()
@@ -175,16 +173,16 @@ static void init_small_pile()
 	const Vec3 z_offset(0.0, 0.0, dist);
 
 	// floor
-	bVector.push_back(new Body(center - 50*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 100, 100), .6, 0.5, 0));
-
-	bVector.push_back(new Body(center + 3*y_offset - 4*x_offset + 0.5*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-	bVector.push_back(new Body(center + 5.5*y_offset - 2.2*x_offset + z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-	bVector.push_back(new Body(center + 3*y_offset - x_offset + 0.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
-	bVector.push_back(new Body(center + 1.7*y_offset - 1.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
-	bVector.push_back(new Body(center + 2*y_offset - 5*x_offset + 2.5*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-	bVector.push_back(new Body(center + 6.5*y_offset - 3.2*x_offset - z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-	bVector.push_back(new Body(center + 3*y_offset - 2*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
-	bVector.push_back(new Body(center + 4.7*y_offset - 3.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
+	bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), .6, 0.5, 0));
+
+	bVector.push_back(new Body(center + 3*y_offset - 4*x_offset + 0.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+	bVector.push_back(new Body(center + 5.5*y_offset - 2.2*x_offset + z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+	bVector.push_back(new Body(center + 3*y_offset - x_offset + 0.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
+	bVector.push_back(new Body(center + 1.7*y_offset - 1.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
+	bVector.push_back(new Body(center + 2*y_offset - 5*x_offset + 2.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+	bVector.push_back(new Body(center + 6.5*y_offset - 3.2*x_offset - z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+	bVector.push_back(new Body(center + 3*y_offset - 2*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
+	bVector.push_back(new Body(center + 4.7*y_offset - 3.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
 }
 
 static void init_high_pile()
@@ -202,26 +200,26 @@ static void init_high_pile()
 	double x_adj = -3;
 
 	// floor
-	bVector.push_back(new Body(center - .5*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(1000, 1, 1000), restitution, 0.5, 0));
+	bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(1000, 0, 1000), restitution, 0.5, 0));
 	
 	// walls
-	bVector.push_back(new Body(center + 10.1*y_offset + (.5 + x_sep*((double)iter/2.0))*x_offset + x_adj*x_offset, Quaternion::Identity, new Box(Color3(1.0, .5, .5)), Vec3(1, 20, z_sep*iter), restitution, 0.5, 0));
-	bVector.push_back(new Body(center + 10.1*y_offset - (.5 + x_sep*((double)iter/2.0))*x_offset + x_adj*x_offset, Quaternion::Identity, new Box(Color3(1.0, .5, .5)), Vec3(1, 20, z_sep*iter), restitution, 0.5, 0));
-	bVector.push_back(new Body(center + 10.1*y_offset + (.5 + z_sep*((double)iter/2.0))*z_offset + x_adj*x_offset, Quaternion::Identity, new Box(Color3(1.0, .5, .5)), Vec3(x_sep*iter, 20, 1), restitution, 0.5, 0));
-	bVector.push_back(new Body(center + 10.1*y_offset - (.5 + z_sep*((double)iter/2.0))*z_offset + x_adj*x_offset, Quaternion::Identity, new Box(Color3(1.0, .5, .5)), Vec3(x_sep*iter, 20, 1), restitution, 0.5, 0));
+	bVector.push_back(new Body(center + 10.1*y_offset + (.5 + x_sep*((double)iter/2.0))*x_offset + x_adj*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1.0, .5, .5), Vec3(1, 20, z_sep*iter), restitution, 0.5, 0));
+	bVector.push_back(new Body(center + 10.1*y_offset - (.5 + x_sep*((double)iter/2.0))*x_offset + x_adj*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1.0, .5, .5), Vec3(1, 20, z_sep*iter), restitution, 0.5, 0));
+	bVector.push_back(new Body(center + 10.1*y_offset + (.5 + z_sep*((double)iter/2.0))*z_offset + x_adj*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1.0, .5, .5), Vec3(x_sep*iter, 20, 1), restitution, 0.5, 0));
+	bVector.push_back(new Body(center + 10.1*y_offset - (.5 + z_sep*((double)iter/2.0))*z_offset + x_adj*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1.0, .5, .5), Vec3(x_sep*iter, 20, 1), restitution, 0.5, 0));
 
 	// 217 total objects
 	for(int i = 0; i < iter; i++){
 		for(int k = 0; k < iter; k++){
 			for(int z = 0; z < iter; z++){
-				bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (4 + (k-1)*x_sep)*x_offset + (0.5 + (z-1)*z_sep)*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(center + (5+18*iter + (i-2)*18)*y_offset - (1.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-				bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (k-1)*x_sep*x_offset + (0.5 + (z-1)*z_sep)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1));
-				bVector.push_back(new Body(center + (1.7+18*iter + (i-2)*18)*y_offset - (1.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1.f));
-				bVector.push_back(new Body(center + (2+18*iter + (i-2)*18)*y_offset - (5 + (k-1)*x_sep)*x_offset + (2.5 + (z-1)*z_sep)*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(center + (6.5+18*iter + (i-2)*18)*y_offset - (3.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (2 + (k-1)*x_sep)*x_offset + (1.5 + (z-1)*z_sep)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1));
-				bVector.push_back(new Body(center + (4.7+18*iter + (i-2)*18)*y_offset - (3.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1));
+				bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (4 + (k-1)*x_sep)*x_offset + (0.5 + (z-1)*z_sep)*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(center + (5+18*iter + (i-2)*18)*y_offset - (1.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+				bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (k-1)*x_sep*x_offset + (0.5 + (z-1)*z_sep)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1));
+				bVector.push_back(new Body(center + (1.7+18*iter + (i-2)*18)*y_offset - (1.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1.f));
+				bVector.push_back(new Body(center + (2+18*iter + (i-2)*18)*y_offset - (5 + (k-1)*x_sep)*x_offset + (2.5 + (z-1)*z_sep)*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(center + (6.5+18*iter + (i-2)*18)*y_offset - (3.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (2 + (k-1)*x_sep)*x_offset + (1.5 + (z-1)*z_sep)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1));
+				bVector.push_back(new Body(center + (4.7+18*iter + (i-2)*18)*y_offset - (3.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1));
 			}
 		}
 	}
@@ -231,14 +229,14 @@ static void init_high_pile()
 	for(int i = 0; i < iter; i++){
 		for(int k = 0; k < iter; k++){
 			for(int z = 0; z < iter; z++){
-				bVector.push_back(new Body(rot*(center + (3+18*iter + (i-2)*18)*y_offset - (4 + (k-1)*x_sep)*x_offset + (0.5 + (z-1)*z_sep)*z_offset), Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(rot*(center + (5+18*iter + (i-2)*18)*y_offset - (1.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(rot*(center + (3+18*iter + (i-2)*18)*y_offset - (k-1)*x_sep*x_offset + (0.5 + (z-1)*z_sep)*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1));
-				bVector.push_back(new Body(rot*(center + (1.7+18*iter + (i-2)*18)*y_offset - (1.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1.f));
-				bVector.push_back(new Body(rot*(center + (2+18*iter + (i-2)*18)*y_offset - (5 + (k-1)*x_sep)*x_offset + (2.5 + (z-1)*z_sep)*z_offset), Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(rot*(center + (6.5+18*iter + (i-2)*18)*y_offset - (3.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), restitution, 0.5, 0.5));
-				bVector.push_back(new Body(rot*(center + (3+18*iter + (i-2)*18)*y_offset - (2 + (k-1)*x_sep)*x_offset + (1.5 + (z-1)*z_sep)*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1));
-				bVector.push_back(new Body(rot*(center + (4.7+18*iter + (i-2)*18)*y_offset - (3.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), restitution, 0.5, 1));
+				bVector.push_back(new Body(rot*(center + (3+18*iter + (i-2)*18)*y_offset - (4 + (k-1)*x_sep)*x_offset + (0.5 + (z-1)*z_sep)*z_offset), Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(rot*(center + (5+18*iter + (i-2)*18)*y_offset - (1.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(rot*(center + (3+18*iter + (i-2)*18)*y_offset - (k-1)*x_sep*x_offset + (0.5 + (z-1)*z_sep)*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1));
+				bVector.push_back(new Body(rot*(center + (1.7+18*iter + (i-2)*18)*y_offset - (1.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1.f));
+				bVector.push_back(new Body(rot*(center + (2+18*iter + (i-2)*18)*y_offset - (5 + (k-1)*x_sep)*x_offset + (2.5 + (z-1)*z_sep)*z_offset), Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(rot*(center + (6.5+18*iter + (i-2)*18)*y_offset - (3.2 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), restitution, 0.5, 0.5));
+				bVector.push_back(new Body(rot*(center + (3+18*iter + (i-2)*18)*y_offset - (2 + (k-1)*x_sep)*x_offset + (1.5 + (z-1)*z_sep)*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1));
+				bVector.push_back(new Body(rot*(center + (4.7+18*iter + (i-2)*18)*y_offset - (3.5 + (k-1)*x_sep)*x_offset + (z-1)*z_sep*z_offset), Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), restitution, 0.5, 1));
 			}
 		}
 	}
@@ -253,17 +251,17 @@ static void init_big_pile()
 	const Vec3 z_offset(0.0, 0.0,dist);
 
 	// floor
-	bVector.push_back(new Body(center - 50*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 100, 100), .3, 0.5, 0));
-
-	bVector.push_back(new Body(center + 5*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), new Box(Color3(.1, .8, .7)), Vec3(1, 1, 1), .7, 0.5, 1));
-	bVector.push_back(new Body(center + 4.5*y_offset + 2*x_offset - z_offset, Quaternion::Identity, new Box(Color3(.7, .0, .4)), Vec3(1, 1, 1), .7, 0.5, 1));
-	bVector.push_back(new Body(center + 4.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, new Box(Color3(1., .4, .1)), Vec3(1, 1, 1), .7, 0.5, 1));
-	bVector.push_back(new Body(center + 8*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), new Box(Color3(.0, .4, .2)), Vec3(1, 1, 1), .7, 0.5, 1));
-	bVector.push_back(new Body(center + 7*y_offset + 2*x_offset - z_offset, Quaternion(Vec3(0.0, 1.0, 1.0), PI/6.0), new Box(Color3(.0, .1, .7)), Vec3(1, 1, 1), .7, 0.5, 1));
-	bVector.push_back(new Body(center + 7.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, new Box(Color3(.3, .3, .3)), Vec3(1, 1, 1), .7, 0.5, 1));
-	bVector.push_back(new Body(center + 3.5*y_offset + 1*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 3), .7, 0.5, 1./6.));
-	bVector.push_back(new Body(center + 1.5*y_offset + 2*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 2, 2), .7, 0.5, .125));
-	bVector.push_back(new Body(center + 6*y_offset + 3*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/2.5), new Box(Color3(.1, .7, .1)), Vec3(1, 2, 2), .7, 0.5, .25));
+	bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), .3, 0.5, 0));
+
+	bVector.push_back(new Body(center + 5*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .8, .7), Vec3(1, 1, 1), .7, 0.5, 1));
+	bVector.push_back(new Body(center + 4.5*y_offset + 2*x_offset - z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.7, .0, .4), Vec3(1, 1, 1), .7, 0.5, 1));
+	bVector.push_back(new Body(center + 4.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1., .4, .1), Vec3(1, 1, 1), .7, 0.5, 1));
+	bVector.push_back(new Body(center + 8*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), ShapeRegistry::get(SHAPE_BOX), Color3(.0, .4, .2), Vec3(1, 1, 1), .7, 0.5, 1));
+	bVector.push_back(new Body(center + 7*y_offset + 2*x_offset - z_offset, Quaternion(Vec3(0.0, 1.0, 1.0), PI/6.0), ShapeRegistry::get(SHAPE_BOX), Color3(.0, .1, .7), Vec3(1, 1, 1), .7, 0.5, 1));
+	bVector.push_back(new Body(center + 7.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.3, .3, .3), Vec3(1, 1, 1), .7, 0.5, 1));
+	bVector.push_back(new Body(center + 3.5*y_offset + 1*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 3), .7, 0.5, 1./6.));
+	bVector.push_back(new Body(center + 1.5*y_offset + 2*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 2, 2), .7, 0.5, .125));
+	bVector.push_back(new Body(center + 6*y_offset + 3*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/2.5), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 2, 2), .7, 0.5, .25));
 }
 
 static void init_stack()
@@ -275,16 +273,16 @@ static void init_stack()
 	const Vec3 z_offset(0.0, 0.0,dist);
 
 	// floor
-	bVector.push_back(new Body(center - 100*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(200, 200, 200), .3, 0.5, 0));
-
-	bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset + 2.5*z_offset, Quaternion::Identity, new Box(Color3(.1, .8, .7)), Vec3(1, 1, 1), .4, 0.5, 1));
-	bVector.push_back(new Body(center + 10.7*y_offset + 2*x_offset + 1.0*z_offset, Quaternion::Identity, new Box(Color3(.7, .0, .4)), Vec3(1, 1, 1), .4, 0.5, 1));
-	bVector.push_back(new Body(center + 9.5*y_offset + 2.3*x_offset + 1.0*z_offset, Quaternion::Identity, new Box(Color3(1., .4, .1)), Vec3(1, 1, 1), .4, 0.5, 1));
-	bVector.push_back(new Body(center + 9.5*y_offset + 1.2*x_offset + 1.0*z_offset, Quaternion::Identity, new Box(Color3(.6, .4, .4)), Vec3(1, 1, 1), .4, 0.5, 1));
-	bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset - z_offset, Quaternion::Identity, new Box(Color3(.0, .4, .2)), Vec3(1.5, 1.5, 1.5), .7, 0.5, 1.0/3.375));
-	bVector.push_back(new Body(center + 50*y_offset + 2*x_offset - 4.5*z_offset, Quaternion::Identity, new Box(Color3(.3, .3, .3)), Vec3(2, 2, 2), .7, 0.5, .125));
-	bVector.push_back(new Body(center + 8.5*y_offset + 2*x_offset - 1*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(4, .3, 10), .4, 0.5, 1./6.));
-	bVector.push_back(new Body(center + 4.1*y_offset + 2*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 8, 2), .4, 0.5, 1.0/32.0));
+	bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(200, 0, 200), .3, 0.5, 0));
+
+	bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset + 2.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .8, .7), Vec3(1, 1, 1), .4, 0.5, 1));
+	bVector.push_back(new Body(center + 10.7*y_offset + 2*x_offset + 1.0*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.7, .0, .4), Vec3(1, 1, 1), .4, 0.5, 1));
+	bVector.push_back(new Body(center + 9.5*y_offset + 2.3*x_offset + 1.0*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1., .4, .1), Vec3(1, 1, 1), .4, 0.5, 1));
+	bVector.push_back(new Body(center + 9.5*y_offset + 1.2*x_offset + 1.0*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.6, .4, .4), Vec3(1, 1, 1), .4, 0.5, 1));
+	bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset - z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.0, .4, .2), Vec3(1.5, 1.5, 1.5), .7, 0.5, 1.0/3.375));
+	bVector.push_back(new Body(center + 50*y_offset + 2*x_offset - 4.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.3, .3, .3), Vec3(2, 2, 2), .7, 0.5, .125));
+	bVector.push_back(new Body(center + 8.5*y_offset + 2*x_offset - 1*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(4, .3, 10), .4, 0.5, 1./6.));
+	bVector.push_back(new Body(center + 4.1*y_offset + 2*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 8, 2), .4, 0.5, 1.0/32.0));
 }
 
 static void init_tall_stack()
@@ -298,11 +296,25 @@ static void init_tall_stack()
 	double box_height = 1.0;
 
 	// floor
-	bVector.push_back(new Body(center - .5*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(200, 1, 200), .3, 0.5, 0));
+	bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(200, 0, 200), .3, 0.5, 0));
 
 	for(int i = 0; i < 1; i++)
 	{
-		bVector.push_back(new Body(center + ((1.5 + 100000*EPSILON)*box_height + (box_height + 100000*EPSILON)*i)*y_offset + (i % 1)*.05*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/2.5), new Box(Color3((i % 5)/15.0 + 0.67, (i % 4)/12.0 + 0.67, (i % 2)/6.0 + 0.67)), Vec3(1, 1, 1), .4, 0.5, 1));
+		bVector.push_back(new Body(center + ((1.5 + 100000*EPSILON)*box_height + (box_height + 100000*EPSILON)*i)*y_offset + (i % 1)*.05*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/2.5), ShapeRegistry::get(SHAPE_BOX), Color3((i % 5)/15.0 + 0.67, (i % 4)/12.0 + 0.67, (i % 2)/6.0 + 0.67), Vec3(1, 1, 1), .4, 0.5, 1));
+	}
+}
+
+/**
+ * Remembers where the bodies are, so they can be drawn between this pose and
+ * the one after the next step.
+ **/
+static void save_last_pose()
+{
+	for(int i = 0; i < sys->num_bodies(); ++i)
+	{
+		Body *b = sys->bVector[i];
+		last_pose[b->id].Pos = b->Position;
+		last_pose[b->id].Orientation = b->Orientation;
 	}
 }
 
@@ -341,11 +353,9 @@ static void init_system( int i )
 	}
 
 	sys = new System(bVector);
-	
-	prev_pos = new double[sys->size_pos()];
-	prev_vel = new double[sys->size_vel()];
-	y_vel = new double[VEL_STATE_SIZE];
-	memset(y_vel, 0, sizeof(double)*VEL_STATE_SIZE);
+
+	last_pose.resize(sys->num_bodies());
+	save_last_pose();
 }
 
 /*********************************************************************
@@ -396,6 +406,16 @@ static void remap_GUI()
 	{
 		sys->bVector[ii]->reset();
 	}
+	save_last_pose();
+}
+
+/**
+ * Switches the frames to a new kind of integrator.
+ **/
+static void select_integrator(RBIntegratorType type)
+{
+	integrator_type = type;
+	printf("integrator: %s\n", rb_integrator_name(type));
 }
 
 /*********************************************************************
@@ -410,6 +430,10 @@ static void key_func ( unsigned char key, int x, int y )
 		remap_GUI();
 		break;
 
+		case 'i':
+		select_integrator((RBIntegratorType) ((integrator_type + 1) % NUM_RB_INTEGRATOR_TYPES));
+		break;
+
 		case 'Q':
 		case 'q':
 		case 27:
@@ -486,86 +510,12 @@ static void reshape_func ( int width, int height )
 	win_y = height;
 }
 
-/***********************************************************************
-* Build a contact graph in the system based on the current state.
-************************************************************************/
-void create_contact_graph()
-{
-	// clear contact graph
-	for(int i = 0; i < sys->num_bodies(); ++i)
-		sys->bVector[i]->in_contact_list.clear();
-
-	Vec3 p, p1, p2, normal;
-	// create contact graph
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		// static objects should never be considered as resting on anything
-		if(sys->bVector[i]->inv_mass != 0){
-			// evolve each object along the y-axis while keeping the others stationary and test for intersection
-			sys->get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-			sys->get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-
-			// grab the y component of the velocity and keep only that.
-			y_vel[1] = prev_vel[i*VEL_STATE_SIZE + 1];
-			if(y_vel[1] > 0)
-			{
-				// Make sure that the object moves down or else there might
-				// be an object above this one that will then count as being below it.
-				y_vel[1] = -y_vel[1];
-			}
-			else
-			{
-				// Increase the current velocity by a factor of 3 to account for
-				// any increase in velocity due to future contact resolutions.
-				y_vel[1] *= 3;
-			}
-			sys->set_state_vel(y_vel, i);
-			integrator->integrate_pos(*sys, dt, i);
-
-			for(int k = 0; k < sys->num_bodies(); ++k){
-				// add the contact to the bodies list if there is one
-#if USE_XENOCOLLIDE
-				if(k != i && Body::intersection_test(sys->bVector[k], sys->bVector[i], p1, p2, normal))
-#else
-				if(k != i && sys->bVector[k]->intersection_test(sys->bVector[i], p, normal))
-#endif
-				{
-					sys->bVector[i]->in_contact_list.push_back(sys->bVector[k]);
-				}
-			}
-			
-			// Reset this body
-			sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-			sys->set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-		}
-	}
-
-	// sort bodies based on the new contact graph
-	sys->topological_tarjan();
-}
-
 #define PERFORMANCE 1
-static void idle_func ( int value )
+/**
+ * Advances the simulation by one step of dt.
+ **/
+static void step_simulation()
 {
-	// cap the fps
-	glutTimerFunc (frame_time, idle_func, 0 );
-	
-	// calculate fps and dt and reset system if necessary
-	int cur_time = glutGet(GLUT_ELAPSED_TIME);
-	if(cur_time - prev_fps_taken_time > 3000)
-	{
-		printf("fps: %g\n", 1000.0*frame_number/(double) (cur_time - prev_fps_taken_time));
-		prev_fps_taken_time = cur_time;
-
-		if(reset_time > 0){
-			if(cur_time - start_time > reset_time){
-				start_time = cur_time;
-				remap_GUI();
-			}
-		}
-
-		frame_number = 0;
-	}
-	
 	// randomly shuffle the body array to eliminate bias
 	for(int ii = 0; ii < 15; ii++)
 	{
@@ -580,110 +530,47 @@ static void idle_func ( int value )
 	}
 	// update the local copy
 	sys->get_bodies(bVector);
-	
-
-	/***********************/
-	/* collision detection */
-	/***********************/
 
-	// get x and v
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		sys->get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-		sys->get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-	}
-
-	// set system to x' and v'
-	sys->zero_forces();
-	sys->add_gravity();
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		integrator->integrate_vel(*sys, dt, i);
-		integrator->integrate_pos(*sys, dt, i);
-	}
+	sys->step(integrator_type, dt);
 
-	// find and resolve collisions
-	int count;
-	for(count = 0; count < MAX_COLLISIONS; count++){
-		if(sys->collsion_detect(integrator, dt, prev_pos, prev_vel))
-		{
-			// set the system back to x and v where v has collision info
-			for(int i = 0; i < sys->num_bodies(); ++i){
-				sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-				sys->set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-			}
-			// get new x' and v'
-			sys->zero_forces();
-			sys->add_gravity();
-			for(int i = 0; i < sys->num_bodies(); ++i){
-				integrator->integrate_vel(*sys, dt, i);
-				integrator->integrate_pos(*sys, dt, i);
-			}
-		}
-		else
-		{
-			break;
-		}
-	}
-	
 #if PERFORMANCE
-	printf("collision iterations: %d\n", count);
+	printf("collision iterations: %d\n", sys->collision_iterations);
+	printf("contact iterations: %d\n", sys->contact_iterations);
+	printf("--------------------------------\n");
 #endif
+}
 
-	// set the system back to x and v where v has final collision info
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-		sys->set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-	}
-
-	// update forces
-	sys->zero_forces();
-	sys->add_gravity();
-
-	/*********************/
-	/* contact detection */
-	/*********************/
-
-	// integrate velocity
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		integrator->integrate_vel(*sys, dt, i);
-	}
-
-	create_contact_graph();
-	
-	// Save off current x
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		sys->get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-	}
+static void idle_func ( int value )
+{
+	// tick again, each tick runs as many fixed steps as the wall clock has moved on by
+	glutTimerFunc (frame_time, idle_func, 0 );
 	
-	// Set state to x', v'
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		integrator->integrate_pos(*sys, dt, i);
-	}
-
-	// resolve the contacts in the contact graph
-	for(count = 0; count < MAX_CONTACTS + MAX_SHOCK_PROP; count++)
+	// calculate fps and reset system if necessary
+	int cur_time = glutGet(GLUT_ELAPSED_TIME);
+	if(cur_time - prev_fps_taken_time > 3000)
 	{
-		if(sys->contact_detect(integrator, dt, prev_pos, count, count >= MAX_CONTACTS))
-		{
-			// Set state back to x, v' now that it has the new v'.
-			for(int i = 0; i < sys->num_bodies(); ++i){
-				sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-			}
+		double wall = (cur_time - prev_fps_taken_time) / 1000.0;
+		printf("fps: %g, simulated seconds per second: %g\n", frame_number/wall, num_steps*dt/wall);
+		prev_fps_taken_time = cur_time;
 
-			// Set state to the new x', v' before testing for contacts again
-			for(int i = 0; i < sys->num_bodies(); ++i){
-				integrator->integrate_pos(*sys, dt, i);
+		if(reset_time > 0){
+			if(cur_time - start_time > reset_time){
+				start_time = cur_time;
+				remap_GUI();
 			}
 		}
-		else
-		{
-			break;
-		}
+
+		frame_number = 0;
+		num_steps = 0;
+	}
+
+	int steps = timestep->advance((cur_time - prev_tick_time) / 1000.0);
+	prev_tick_time = cur_time;
+	for(int s = 0; s < steps; ++s){
+		save_last_pose();
+		step_simulation();
+		num_steps++;
 	}
-	
-#if PERFORMANCE
-	printf("contact iterations: %d\n", count);
-	printf("--------------------------------\n");
-#endif
 
 	frame_number++;
 
@@ -697,10 +584,14 @@ static void display_func ( void )
 	
     glLightfv(GL_LIGHT0, GL_POSITION, light_position);
 
-	// draw bodies
+	// draw bodies part of the way from their last pose to their current one,
+	// as far as the wall clock is between the two steps
+	double alpha = timestep->alpha();
 	for(int ii = 0; ii < ((System *) sys)->num_bodies(); ++ii)
 	{
-		sys->bVector[ii]->draw();
+		Body *b = sys->bVector[ii];
+		const BodyInfo &last = last_pose[b->id];
+		b->draw(last.Pos + alpha*(b->Position - last.Pos), slerp(last.Orientation, b->Orientation, alpha));
 	}
 	
 	post_display();
@@ -749,7 +640,15 @@ int main ( int argc, char ** argv )
 {
 	glutInit ( &argc, argv );
 
-	integrator = new EulerRBIntegrator();
+	if(argc > 2)
+	{
+		integrator_type = rb_integrator_from_name(argv[2]);
+		if(integrator_type == NUM_RB_INTEGRATOR_TYPES)
+		{
+			fprintf(stderr, "unknown integrator %s\n", argv[2]);
+			exit(1);
+		}
+	}
 
 	dt = 0.016f;
 	dsim = 0;
@@ -769,8 +668,10 @@ int main ( int argc, char ** argv )
 	win_y = 900;
 	open_glut_window ();
 
+	timestep = new FixedTimestep(dt, MAX_SUBSTEPS);
 	start_time = glutGet(GLUT_ELAPSED_TIME);
 	prev_fps_taken_time = start_time;
+	prev_tick_time = start_time;
 
 	srand(time(NULL));
 
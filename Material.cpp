@@ -109,6 +109,11 @@ bool Material::create_gl_data()
 }
 
 void Material::set_gl_state() const
+{
+    set_gl_state( diffuse );
+}
+
+void Material::set_gl_state( const Color3& i_diffuse ) const
 {
     float arr[4];
     arr[3] = 1.0; // alpha always 1.0
@@ -118,7 +123,7 @@ void Material::set_gl_state() const
 
     ambient.to_array( arr );
     glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT,   arr );
-    diffuse.to_array( arr );
+    i_diffuse.to_array( arr );
     glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, arr );
     specular.to_array( arr );
     glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR,  arr );
@@ -71,6 +71,8 @@ public:
 
     /// sets all the gl state for this material
     void set_gl_state() const;
+    /// sets the gl state for this material with a diffuse color of its user
+    void set_gl_state( const Color3& diffuse ) const;
 
     /// clears out setting that depend on this material, such as the texture.
     /// leaves other settings unchanged for efficiency.
@@ -11,8 +11,13 @@
 #include <algorithm>
 #include <cmath>
 
-// floating point precision set by this typedef
+// floating point precision set by this typedef. Building with -DREAL_FLOAT
+// runs the whole simulation in single precision, see gfx::Vec3.
+#ifdef REAL_FLOAT
+typedef float real_t;
+#else
 typedef double real_t;
+#endif
 
 class Color3;
 
@@ -13,8 +13,22 @@
 
 #define USE_XENOCOLLIDE 1
 
+/**
+ * The kinds of shape a model can have. Used to pick the narrowphase test of a pair.
+ */
+enum ShapeType
+{
+    SHAPE_BOX,
+    SHAPE_CONVEX,
+    SHAPE_PLANE,
+    NUM_SHAPE_TYPES
+};
+
 /**
  * A Trianglular mesh with an inertia tenser and signed distance function.
+ *
+ * Models are shared by every body of their shape, see ShapeRegistry, so
+ * they hold nothing of a single body and are never changed once made.
  */
 class Model
 {
@@ -23,9 +37,13 @@ public:
     Model(){}
     virtual ~Model(){}
 
-    virtual void render() const = 0;
-    virtual void get_Iinv( Matrix3& Iinv, Vec3 size, double inv_mass) = 0;
+    /**
+     * Draws the unit shape in the body's colour.
+     */
+    virtual void render(const Color3 &color) const = 0;
+    virtual void get_Iinv( Matrix3& Iinv, Vec3 size, real_t inv_mass) const = 0;
     virtual int num_vertices() const = 0;
+    virtual ShapeType shape_type() const { return SHAPE_CONVEX; }
 #if USE_XENOCOLLIDE
     virtual Vec3 GetSupportPoint(const Vec3& normal) const = 0;
 #else
@@ -0,0 +1,124 @@
+/**
+ * @file PairCache.cpp
+ * @brief Contact information kept for each touching pair of bodies between frames.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "PairCache.h"
+#include "Body.h"
+#include <math.h>
+
+void ContactManifold::get_world_points(const Body *first, const Body *second, int i, Vec3 &p1, Vec3 &p2) const
+{
+    p1 = first->Orientation*points[i].local1 + first->Position;
+    p2 = second->Orientation*points[i].local2 + second->Position;
+}
+
+Vec3 ContactManifold::get_world_normal(const Body *first) const
+{
+    return first->Orientation*local_normal;
+}
+
+PairCache::PairCache() : enabled(true), seed_tests(true), num_hits(0), num_tests(0), frame(0)
+{
+}
+
+std::pair<int, int> PairCache::key(const Body *b1, const Body *b2)
+{
+    if(b1->id < b2->id)
+        return std::make_pair(b1->id, b2->id);
+    return std::make_pair(b2->id, b1->id);
+}
+
+/**
+ * Computes the position and orientation of the second body in the frame of the first.
+ **/
+void PairCache::relative_pose(const Body *first, const Body *second, Vec3 &rel_pos, Quaternion &rel_orient)
+{
+    Quaternion inv_orientation = conjugate(first->Orientation);
+    rel_pos = inv_orientation*(second->Position - first->Position);
+    rel_orient = inv_orientation*second->Orientation;
+}
+
+ContactManifold& PairCache::get(const Body *b1, const Body *b2)
+{
+    ContactManifold &m = manifolds[key(b1, b2)];
+    m.last_frame = frame;
+    return m;
+}
+
+ContactManifold* PairCache::find(const Body *b1, const Body *b2)
+{
+    ManifoldMap::iterator it = manifolds.find(key(b1, b2));
+    if(it == manifolds.end())
+        return NULL;
+    return &it->second;
+}
+
+ContactManifold* PairCache::lookup(const Body *b1, const Body *b2)
+{
+    ContactManifold *m = find(b1, b2);
+    if(m)
+        m->last_frame = frame;
+    return m;
+}
+
+bool PairCache::is_current(const ContactManifold &m, const Body *first, const Body *second) const
+{
+    if(!enabled || !m.has_pose)
+        return false;
+
+    Vec3 rel_pos;
+    Quaternion rel_orient;
+    relative_pose(first, second, rel_pos, rel_orient);
+
+    for(int k = 0; k < 3; ++k){
+        if(fabs(rel_pos[k] - m.rel_pos[k]) > PAIR_CACHE_TOLERANCE)
+            return false;
+    }
+    return fabs(rel_orient.w - m.rel_orient.w) <= PAIR_CACHE_TOLERANCE &&
+           fabs(rel_orient.x - m.rel_orient.x) <= PAIR_CACHE_TOLERANCE &&
+           fabs(rel_orient.y - m.rel_orient.y) <= PAIR_CACHE_TOLERANCE &&
+           fabs(rel_orient.z - m.rel_orient.z) <= PAIR_CACHE_TOLERANCE;
+}
+
+void PairCache::store(ContactManifold &m, const Body *first, const Body *second, bool touching,
+                      const Vec3 *p1, const Vec3 *p2, int num_points, const Vec3 &normal)
+{
+    relative_pose(first, second, m.rel_pos, m.rel_orient);
+    m.has_pose = true;
+    m.touching = touching;
+    m.num_points = 0;
+    if(!touching)
+        return;
+
+    Quaternion inv_orientation1 = conjugate(first->Orientation);
+    Quaternion inv_orientation2 = conjugate(second->Orientation);
+    m.local_normal = inv_orientation1*normal;
+
+    for(int i = 0; i < num_points && i < MAX_MANIFOLD_POINTS; ++i){
+        ContactPoint &c = m.points[m.num_points++];
+        c.local1 = inv_orientation1*(p1[i] - first->Position);
+        c.local2 = inv_orientation2*(p2[i] - second->Position);
+    }
+}
+
+void PairCache::new_frame()
+{
+    ManifoldMap::iterator it = manifolds.begin();
+    while(it != manifolds.end()){
+        if(it->second.last_frame != frame)
+            manifolds.erase(it++);
+        else
+            ++it;
+    }
+    frame++;
+}
+
+void PairCache::clear()
+{
+    manifolds.clear();
+    num_hits = 0;
+    num_tests = 0;
+}
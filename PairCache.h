@@ -0,0 +1,140 @@
+/**
+ * @file PairCache.h
+ * @brief Contact information kept for each touching pair of bodies between frames.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <map>
+#include <utility>
+#include <gfx/vec3.h>
+#include "quaternion.h"
+#include "Body.h"
+#include "Collide.h"
+
+#define MAX_MANIFOLD_POINTS MAX_CONTACT_POINTS
+
+// how far the pose of one body may drift relative to the other before a
+// cached narrowphase result is thrown away, in world units and quaternion components
+#define PAIR_CACHE_TOLERANCE 1e-9
+
+/**
+ * A single contact between two bodies. The points are stored in the frame
+ * of their own body so they follow the bodies as they move.
+ */
+struct ContactPoint
+{
+    Vec3 local1;
+    Vec3 local2;
+};
+
+/**
+ * The last narrowphase result of a pair of bodies. The first body is the
+ * one with the smaller Body::id.
+ */
+struct ContactManifold
+{
+    bool touching;
+    // points from the first body to the second, in the frame of the first body
+    Vec3 local_normal;
+    ContactPoint points[MAX_MANIFOLD_POINTS];
+    int num_points;
+
+    // pose of the second body in the frame of the first when this was computed
+    Vec3 rel_pos;
+    Quaternion rel_orient;
+    bool has_pose;
+
+    // where the next XenoCollide test of the pair starts its search
+    MPRCache mpr;
+
+    int last_frame;
+
+    ContactManifold() : touching(false), num_points(0), has_pose(false), last_frame(0) {}
+
+    /**
+     * Gets the world position of the ith contact on each body.
+     */
+    void get_world_points(const Body *first, const Body *second, int i, Vec3 &p1, Vec3 &p2) const;
+    Vec3 get_world_normal(const Body *first) const;
+};
+
+/**
+ * Persistent map from a pair of bodies to their contact manifold.
+ *
+ * The collision and contact passes test the same pairs many times a frame,
+ * and resting bodies barely move between frames. The narrowphase result is
+ * kept until either body moves relative to the other, so only the pairs
+ * whose relative pose changed pay for a new test. Pairs which were not
+ * looked up during a frame are dropped by new_frame().
+ *
+ * get() may add to the map and must not run concurrently with anything else.
+ * lookup() and store() only touch the manifold of their own pair, so
+ * threads working on different pairs may call them at once.
+ */
+class PairCache
+{
+public:
+    PairCache();
+
+    /**
+     * Finds the manifold of the pair, creating an empty one if there is none.
+     * The bodies may be given in either order.
+     */
+    ContactManifold& get(const Body *b1, const Body *b2);
+
+    /**
+     * Finds the manifold of the pair, NULL if the pair is not cached.
+     */
+    ContactManifold* find(const Body *b1, const Body *b2);
+
+    /**
+     * Like find(), but marks the manifold as used this frame. It never changes
+     * the map, so threads may look up different pairs at the same time.
+     */
+    ContactManifold* lookup(const Body *b1, const Body *b2);
+
+    /**
+     * returns true if the bodies have not moved relative to each other since
+     * the manifold was stored, so the narrowphase does not need to be run again
+     */
+    bool is_current(const ContactManifold &m, const Body *first, const Body *second) const;
+
+    /**
+     * Replaces the contents of the manifold with a new narrowphase result.
+     * p1[i] and p2[i] are the world contact points on each body and the normal
+     * points from the first body to the second.
+     */
+    void store(ContactManifold &m, const Body *first, const Body *second, bool touching,
+               const Vec3 *p1, const Vec3 *p2, int num_points, const Vec3 &normal);
+
+    /**
+     * Drops the pairs which were not used during the finished frame. Call
+     * once at the start of every frame.
+     */
+    void new_frame();
+
+    void clear();
+    int size() const { return manifolds.size(); }
+
+    // with the cache disabled is_current always fails and every test is run
+    bool enabled;
+    // start each XenoCollide test from the direction left by the last test of the pair
+    bool seed_tests;
+
+    // number of narrowphase tests skipped and run since the last clear,
+    // updated atomically by the passes
+    int num_hits;
+    int num_tests;
+
+private:
+    typedef std::map<std::pair<int, int>, ContactManifold> ManifoldMap;
+
+    static std::pair<int, int> key(const Body *b1, const Body *b2);
+    static void relative_pose(const Body *first, const Body *second, Vec3 &rel_pos, Quaternion &rel_orient);
+
+    ManifoldMap manifolds;
+    int frame;
+};
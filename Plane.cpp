@@ -0,0 +1,59 @@
+/**
+ * @file Plane.cpp
+ * @brief An infinite plane for floors.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "Plane.h"
+
+Plane::Plane()
+{
+    mesh = NULL;
+    material = new Material();
+    material->ambient = Color3(1.0, 1.0, 1.0);
+    material->specular = Color3::White;
+}
+
+Plane::~Plane() { delete material; }
+
+void Plane::render(const Color3 &color) const
+{
+    if ( material )
+        material->set_gl_state(color);
+    glBegin(GL_QUADS);
+    glNormal3d(0.0, 1.0, 0.0);
+    glVertex3d(-0.5, 0.0, 0.5);
+    glVertex3d(0.5, 0.0, 0.5);
+    glVertex3d(0.5, 0.0, -0.5);
+    glVertex3d(-0.5, 0.0, -0.5);
+    glEnd();
+    if ( material )
+        material->reset_gl_state();
+}
+
+void Plane::get_Iinv(Matrix3& Iinv, Vec3 size, real_t inv_mass) const
+{
+    // planes never move
+    Iinv = Matrix3(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.0));
+}
+
+int Plane::num_vertices() const
+{
+    return 0;
+}
+
+#if USE_XENOCOLLIDE
+Vec3 Plane::GetSupportPoint(const Vec3& local_normal) const
+{
+    return Vec3(local_normal[0] < 0.0 ? -0.5 : 0.5, 0.0, local_normal[2] < 0.0 ? -0.5 : 0.5);
+}
+#else
+bool Plane::intersection_test(Vec3 p, Vec3 &normal) const
+{
+    if(p[1] >= 0.0)
+        return false;
+    normal = Vec3(0, 1, 0);
+    return true;
+}
+#endif
@@ -0,0 +1,40 @@
+/**
+ * @file Plane.h
+ * @brief An infinite plane for floors.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include "Model.h"
+#include <OpenGL/gl.h>
+
+/**
+ * The half space below the plane y = 0 of the body, with the body's y axis
+ * as its outward normal. Only the square given by the body's x and z size
+ * is drawn, but collisions reach over the whole plane.
+ *
+ * Planes must be static. They are kept out of the broadphase and every
+ * moving body is paired with every plane, and the narrowphase tests them
+ * with collide_box_plane and collide_convex_plane rather than XenoCollide.
+ */
+class Plane : public Model{
+public:
+    Plane();
+    virtual ~Plane();
+
+    virtual void render(const Color3 &color) const;
+    virtual void get_Iinv(Matrix3& Iinv, Vec3 size, real_t inv_mass) const;
+    virtual int num_vertices() const;
+    virtual ShapeType shape_type() const { return SHAPE_PLANE; }
+#if USE_XENOCOLLIDE
+    /**
+     * The support point of the drawn square. A half space has none, so this
+     * is only here to fill in the interface.
+     */
+    virtual Vec3 GetSupportPoint(const Vec3& normal) const;
+#else
+	virtual bool intersection_test(Vec3 p, Vec3 &normal) const;
+#endif
+};
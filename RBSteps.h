@@ -0,0 +1,234 @@
+/**
+ * @file RBSteps.h
+ * @brief The steps of the rigid body integrators, templated on the system.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <string.h>
+#include "integrator.h"
+
+/**
+ * Recovers the angular velocity from an orientation and its derivative,
+ * dq/dt = 0.5 * (0, w) * q, so (0, w) = 2 * dq/dt * conjugate(q).
+ */
+void rb_angular_velocity( const real_t q[4], const real_t q_dot[4], real_t w[3] );
+
+/**
+ * Sets q to q0 turned by the angular velocity w for time dt, using the
+ * exponential map exp(0.5 * w * dt) * q0.
+ */
+void rb_rotate( const real_t q0[4], const real_t w[3], real_t dt, real_t q[4] );
+
+/**
+ * Moves the position state x0 along the derivative x_dot for time dt into x,
+ * turning the orientation with the exponential map. at is the state x_dot
+ * was evaluated at.
+ */
+void rb_advance_pos( const real_t x0[RB_POS_SIZE], const real_t at[RB_POS_SIZE],
+                     const real_t x_dot[RB_POS_SIZE], real_t dt, real_t x[RB_POS_SIZE] );
+
+/**
+ * Maps the angular velocity w at the rotation exp(u) * q0 back to the rate of
+ * change of u, the inverse of the derivative of the exponential map, to
+ * third order: w - [u, w]/2 + [u, [u, w]]/12.
+ */
+void rb_dexp_inv( const real_t u[3], const real_t w[3], real_t u_dot[3] );
+
+/**
+ * One step of body i of a system of type S with each of the rigid body
+ * integrators. S provides the per-body calls body_get_pos, body_set_pos,
+ * body_deriv_pos, the same for vel, and body_asleep. With S an
+ * IntegrableSystem they are virtual calls, which is how the RBIntegrator
+ * classes use these. With S a StaticIntegrableSystem they bind at compile
+ * time and inline into the step, see System::integrate_body_pos.
+ */
+template <class S>
+struct RBSteps
+{
+    /**
+     * Euler, x' = x + dx/dt * dt.
+     */
+    static void euler_pos( S& sys, real_t dt, int i )
+    {
+        if (sys.body_asleep(i))
+            return;
+        real_t state[RB_POS_SIZE];
+        real_t deriv_state[RB_POS_SIZE];
+
+        sys.body_get_pos( state, i );
+        sys.body_deriv_pos( deriv_state, i );
+        for(int k = 0; k < RB_POS_SIZE; ++k){
+            state[k] += deriv_state[k]*dt;
+        }
+        sys.body_set_pos( state, i );
+    }
+
+    /**
+     * Euler step of the momenta, shared by all the rigid body integrators
+     * since the forces are constant over a step.
+     */
+    static void euler_vel( S& sys, real_t dt, int i )
+    {
+        if (sys.body_asleep(i))
+            return;
+        real_t state[RB_VEL_SIZE];
+        real_t deriv_state[RB_VEL_SIZE];
+
+        sys.body_get_vel( state, i );
+        sys.body_deriv_vel( deriv_state, i );
+        for(int k = 0; k < RB_VEL_SIZE; ++k){
+            state[k] += deriv_state[k]*dt;
+        }
+        sys.body_set_vel( state, i );
+    }
+
+    /**
+     * Semi-implicit Euler, see SymplecticEulerRBIntegrator.
+     */
+    static void symplectic_euler_pos( S& sys, real_t dt, int i )
+    {
+        if (sys.body_asleep(i))
+            return;
+        real_t state[RB_POS_SIZE];
+        real_t deriv_state[RB_POS_SIZE];
+
+        sys.body_get_pos( state, i );
+        sys.body_deriv_pos( deriv_state, i );
+        rb_advance_pos( state, state, deriv_state, dt, state );
+        sys.body_set_pos( state, i );
+    }
+
+    /**
+     * Velocity Verlet, see VerletRBIntegrator.
+     */
+    static void verlet_pos( S& sys, real_t dt, int i )
+    {
+        if (sys.body_asleep(i))
+            return;
+        real_t start[RB_POS_SIZE];
+        real_t deriv_state[RB_POS_SIZE];
+        real_t middle[RB_POS_SIZE];
+        real_t deriv_middle[RB_POS_SIZE];
+        real_t vel[RB_VEL_SIZE];
+
+        sys.body_get_pos( start, i );
+        sys.body_get_vel( vel, i );
+        sys.body_deriv_pos( deriv_state, i );
+
+        // the angular velocity half way through the turn
+        rb_advance_pos( start, start, deriv_state, 0.5*dt, middle );
+        sys.body_set_pos( middle, i );
+        sys.body_set_vel( vel, i );
+        sys.body_deriv_pos( deriv_middle, i );
+
+        real_t x[RB_POS_SIZE];
+        for(int k = 0; k < RB_ORIENT; ++k)
+            x[k] = start[k] + deriv_state[k]*dt;
+        real_t w[3];
+        rb_angular_velocity( middle + RB_ORIENT, deriv_middle + RB_ORIENT, w );
+        rb_rotate( start + RB_ORIENT, w, dt, x + RB_ORIENT );
+
+        // leave the angular velocity as it was at the start, like the other integrators
+        sys.body_set_pos( start, i );
+        sys.body_set_vel( vel, i );
+        sys.body_set_pos( x, i );
+    }
+
+    /**
+     * Fourth order Runge-Kutta-Munthe-Kaas, see RK4RBIntegrator.
+     */
+    static void rk4_pos( S& sys, real_t dt, int i )
+    {
+        if (sys.body_asleep(i))
+            return;
+        real_t start[RB_POS_SIZE];
+        real_t vel[RB_VEL_SIZE];
+        real_t stage[RB_POS_SIZE];
+        real_t deriv[4][RB_POS_SIZE];
+        // the rotation vector of each stage times dt, the stages turn the start
+        // orientation by the exponential map of a fraction of the last one
+        real_t turn[4][3];
+        const real_t stage_time[4] = { 0.0, 0.5, 0.5, 1.0 };
+        const real_t weight[4] = { 1.0/6.0, 2.0/6.0, 2.0/6.0, 1.0/6.0 };
+
+        sys.body_get_pos( start, i );
+        sys.body_get_vel( vel, i );
+
+        for(int n = 0; n < 4; ++n){
+            real_t u[3] = { 0.0, 0.0, 0.0 };
+            if(n == 0){
+                memcpy( stage, start, sizeof(start) );
+            }
+            else{
+                for(int k = 0; k < 3; ++k)
+                    u[k] = stage_time[n]*turn[n - 1][k];
+                for(int k = 0; k < RB_ORIENT; ++k)
+                    stage[k] = start[k] + deriv[n - 1][k]*stage_time[n]*dt;
+                rb_rotate( start + RB_ORIENT, u, 1.0, stage + RB_ORIENT );
+                sys.body_set_pos( stage, i );
+                // the angular velocity follows the orientation
+                sys.body_set_vel( vel, i );
+            }
+            sys.body_deriv_pos( deriv[n], i );
+
+            real_t w[3];
+            rb_angular_velocity( stage + RB_ORIENT, deriv[n] + RB_ORIENT, w );
+            rb_dexp_inv( u, w, turn[n] );
+            for(int k = 0; k < 3; ++k)
+                turn[n][k] *= dt;
+        }
+
+        real_t x[RB_POS_SIZE];
+        real_t u[3] = { 0.0, 0.0, 0.0 };
+        for(int k = 0; k < RB_ORIENT; ++k){
+            x[k] = start[k];
+            for(int n = 0; n < 4; ++n)
+                x[k] += weight[n]*deriv[n][k]*dt;
+        }
+        for(int n = 0; n < 4; ++n){
+            for(int k = 0; k < 3; ++k)
+                u[k] += weight[n]*turn[n][k];
+        }
+        rb_rotate( start + RB_ORIENT, u, 1.0, x + RB_ORIENT );
+
+        // leave the angular velocity as it was at the start, like the other integrators
+        sys.body_set_pos( start, i );
+        sys.body_set_vel( vel, i );
+        sys.body_set_pos( x, i );
+    }
+
+    /**
+     * The position step of the integrator of the given type.
+     */
+    static void integrate_pos( RBIntegratorType type, S& sys, real_t dt, int i )
+    {
+        switch(type){
+        case RB_EULER:
+            euler_pos( sys, dt, i );
+            break;
+        case RB_SYMPLECTIC_EULER:
+            symplectic_euler_pos( sys, dt, i );
+            break;
+        case RB_VERLET:
+            verlet_pos( sys, dt, i );
+            break;
+        case RB_RK4:
+            rk4_pos( sys, dt, i );
+            break;
+        default:
+            break;
+        }
+    }
+
+    /**
+     * The velocity step of the integrator of the given type, which is Euler
+     * for all of them.
+     */
+    static void integrate_vel( RBIntegratorType type, S& sys, real_t dt, int i )
+    {
+        euler_vel( sys, dt, i );
+    }
+};
@@ -0,0 +1,48 @@
+/**
+ * @file ShapeRegistry.cpp
+ * @brief One shared model for each kind of shape.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "ShapeRegistry.h"
+#include "Box.h"
+#include "Plane.h"
+
+Model *ShapeRegistry::models[NUM_SHAPE_TYPES];
+
+const Model* ShapeRegistry::get(ShapeType type)
+{
+    if(!models[type]){
+        switch(type){
+        case SHAPE_BOX:
+            models[type] = new Box();
+            break;
+        case SHAPE_PLANE:
+            models[type] = new Plane();
+            break;
+        default:
+            // convex bodies need a mesh of their own
+            break;
+        }
+    }
+    return models[type];
+}
+
+void ShapeRegistry::clear()
+{
+    for(int i = 0; i < NUM_SHAPE_TYPES; ++i){
+        delete models[i];
+        models[i] = NULL;
+    }
+}
+
+int ShapeRegistry::num_models()
+{
+    int n = 0;
+    for(int i = 0; i < NUM_SHAPE_TYPES; ++i){
+        if(models[i])
+            n++;
+    }
+    return n;
+}
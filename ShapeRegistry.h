@@ -0,0 +1,43 @@
+/**
+ * @file ShapeRegistry.h
+ * @brief One shared model for each kind of shape.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include "Model.h"
+
+/**
+ * Hands out a single model of each shape for every body of that shape.
+ *
+ * A model holds the mesh and material of its shape, which are the same for
+ * every body, so building one per body only costs startup time and memory.
+ * The colour of a body is kept on the Body, and the size scales the unit
+ * shape, so nothing of a single body lives in its model.
+ *
+ * The models are made the first time they are asked for. get() is not safe
+ * to call from several threads until each shape has been made once.
+ */
+class ShapeRegistry
+{
+public:
+    /**
+     * The shared model of the shape, NULL if there is no model of it.
+     */
+    static const Model* get(ShapeType type);
+
+    /**
+     * Frees the models. No body may use them any more.
+     */
+    static void clear();
+
+    /**
+     * The number of models made so far.
+     */
+    static int num_models();
+
+private:
+    static Model *models[NUM_SHAPE_TYPES];
+};
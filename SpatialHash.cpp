@@ -0,0 +1,124 @@
+/**
+ * @file SpatialHash.cpp
+ * @brief Uniform hashed grid over the bodies' bounding spheres.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "SpatialHash.h"
+#include "Body.h"
+#include <algorithm>
+#include <math.h>
+
+SpatialHash::SpatialHash() : cell_size(1.0), max_radius(0.0), table_mask(0), query_stamp(0)
+{
+}
+
+SpatialHash::~SpatialHash()
+{
+}
+
+unsigned int SpatialHash::hash(int x, int y, int z) const
+{
+    return ((unsigned int) x*73856093u ^ (unsigned int) y*19349663u ^ (unsigned int) z*83492791u) & table_mask;
+}
+
+void SpatialHash::build(const std::vector<Body*> &bodies)
+{
+    entries.clear();
+    large_bodies.clear();
+    max_radius = 0.0;
+    if(bodies.empty())
+        return;
+
+    // size the cells to the diameter of a typical sphere
+    radii.resize(bodies.size());
+    for(int i = 0; i < bodies.size(); ++i)
+        radii[i] = bodies[i]->radius;
+    std::nth_element(radii.begin(), radii.begin() + radii.size()/2, radii.end());
+    real_t typical_radius = std::max<real_t>(radii[radii.size()/2], EPSILON);
+    cell_size = 2.0*typical_radius;
+
+    unsigned int table_size = 1;
+    while(table_size < 2*bodies.size())
+        table_size <<= 1;
+    table_mask = table_size - 1;
+    cell_start.assign(table_size + 1, 0);
+    bucket_stamp.assign(table_size, 0);
+    query_stamp = 0;
+
+    // count the entries in each bucket
+    for(int i = 0; i < bodies.size(); ++i){
+        if(bodies[i]->radius > LARGE_BODY_RATIO*typical_radius){
+            large_bodies.push_back(bodies[i]);
+            continue;
+        }
+        max_radius = std::max(max_radius, bodies[i]->radius);
+        cell_start[hash(bodies[i]->Position) + 1]++;
+    }
+    for(int h = 0; h < table_size; ++h)
+        cell_start[h + 1] += cell_start[h];
+
+    // fill the buckets
+    entries.resize(cell_start[table_size]);
+    next.assign(cell_start.begin(), cell_start.end() - 1);
+    for(int i = 0; i < bodies.size(); ++i){
+        if(bodies[i]->radius > LARGE_BODY_RATIO*typical_radius)
+            continue;
+        entries[next[hash(bodies[i]->Position)]++] = bodies[i];
+    }
+}
+
+void SpatialHash::query(const Vec3 &center, real_t radius, std::vector<Body*> &bodies) const
+{
+    bodies.clear();
+
+    for(int i = 0; i < large_bodies.size(); ++i){
+        if(norm(large_bodies[i]->Position - center) <= large_bodies[i]->radius + radius)
+            bodies.push_back(large_bodies[i]);
+    }
+
+    if(entries.empty())
+        return;
+
+    // any stored body overlapping the sphere has its center within this reach
+    real_t reach = radius + max_radius;
+    // counted in doubles, the cells of a large sphere would overflow an int
+    double num_cells = 1.0;
+    for(int k = 0; k < 3; ++k)
+        num_cells *= floor((center[k] + reach) / cell_size) - floor((center[k] - reach) / cell_size) + 1;
+
+    if(num_cells > entries.size()){
+        // walking the cells would cost more than checking every entry
+        for(int i = 0; i < entries.size(); ++i){
+            if(norm(entries[i]->Position - center) <= entries[i]->radius + radius)
+                bodies.push_back(entries[i]);
+        }
+        return;
+    }
+
+    int lo[3], hi[3];
+    for(int k = 0; k < 3; ++k){
+        lo[k] = cell_coord(center[k] - reach);
+        hi[k] = cell_coord(center[k] + reach);
+    }
+
+    // distinct cells can hash to the same bucket, only visit each bucket once
+    if(++query_stamp == 0){
+        std::fill(bucket_stamp.begin(), bucket_stamp.end(), 0);
+        query_stamp = 1;
+    }
+    for(int x = lo[0]; x <= hi[0]; ++x)
+        for(int y = lo[1]; y <= hi[1]; ++y)
+            for(int z = lo[2]; z <= hi[2]; ++z){
+                unsigned int h = hash(x, y, z);
+                if(bucket_stamp[h] == query_stamp)
+                    continue;
+                bucket_stamp[h] = query_stamp;
+                for(int n = cell_start[h]; n < cell_start[h + 1]; ++n){
+                    Body *b = entries[n];
+                    if(norm(b->Position - center) <= b->radius + radius)
+                        bodies.push_back(b);
+                }
+            }
+}
@@ -0,0 +1,70 @@
+/**
+ * @file SpatialHash.h
+ * @brief Uniform hashed grid over the bodies' bounding spheres.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <vector>
+#include <math.h>
+#include <gfx/vec3.h>
+#include "Math.h"
+
+class Body;
+
+// bodies with a sphere this many times bigger than the typical one are not
+// put in the grid, they are checked by every query instead
+#define LARGE_BODY_RATIO 4.0
+
+/**
+ * A uniform grid with the cells hashed into a fixed size table.
+ *
+ * Each body is stored once, in the cell holding its center, and a query
+ * looks at every cell within reach of the largest stored sphere. The cell
+ * size follows the typical sphere size of the bodies, so a query only
+ * looks at a handful of cells and building the grid is linear in the body
+ * count. Very large bodies such as floors would make every query reach too
+ * far, so they are kept in a separate list that every query checks.
+ */
+class SpatialHash
+{
+public:
+    SpatialHash();
+    ~SpatialHash();
+
+    /**
+     * Rebuilds the grid over the current positions of the given bodies.
+     */
+    void build(const std::vector<Body*> &bodies);
+
+    /**
+     * Finds the bodies whose bounding spheres overlap the given sphere.
+     * Marks the buckets it visits, so only one query may run at a time.
+     * @param bodies[out] Cleared and filled with the overlapping bodies.
+     */
+    void query(const Vec3 &center, real_t radius, std::vector<Body*> &bodies) const;
+
+    real_t get_cell_size() const { return cell_size; }
+
+private:
+    int cell_coord(real_t x) const { return (int) floor(x / cell_size); }
+    unsigned int hash(int x, int y, int z) const;
+    unsigned int hash(const Vec3 &p) const { return hash(cell_coord(p[0]), cell_coord(p[1]), cell_coord(p[2])); }
+
+    real_t cell_size;
+    // largest sphere stored in the grid
+    real_t max_radius;
+    unsigned int table_mask;
+    // cell_start[h] to cell_start[h+1] are the entries hashed to h
+    std::vector<int> cell_start;
+    std::vector<Body*> entries;
+    std::vector<Body*> large_bodies;
+    // scratch space reused between builds
+    std::vector<real_t> radii;
+    std::vector<int> next;
+    // bucket_stamp[h] is query_stamp once a query has visited bucket h
+    mutable std::vector<unsigned int> bucket_stamp;
+    mutable unsigned int query_stamp;
+};
@@ -1,33 +1,249 @@
 #include "System.h"
+#include "RBSteps.h"
 #include <algorithm>
+#include <math.h>
 
 #define LEVEL_ITER 5
-// globals for tarjan's algorithm
-std::vector<Body*> top_sorted;
-std::stack<Body*> S;
-int SCC_num;
 
-static double *curr_pos, *curr_vel, *prev_pos, *prev_vel;
+/**
+ * returns true if the body is a plane, which has no bounding volume
+ **/
+static bool is_plane(const Body *b)
+{
+	return b->shape == SHAPE_PLANE;
+}
 
-System::System(std::vector<Body*> &i_bVector) : bVector(i_bVector),
-                                               size(bVector.size())
+System::System(std::vector<Body*> &i_bVector) : collision_iterations(0),
+                                               contact_iterations(0),
+                                               size(i_bVector.size()),
+                                               broadphase(new AABBTree()),
+                                               sleeping_enabled(true),
+                                               ccd_enabled(true),
+                                               next_island(0),
+                                               num_islands(0),
+                                               workers(NULL),
+                                               in_parallel_pass(false)
 {
-	curr_pos = new double[size_pos()];
-	curr_vel = new double[size_vel()];
-	prev_pos = new double[size_pos()];
-	prev_vel = new double[size_vel()];
+	store.adopt(i_bVector);
+	bVector = i_bVector;
+
+	std::vector<Body*> static_bodies;
+	for(int i = 0; i < size; ++i){
+		all_slots.push_back(i);
+		if(bVector[i]->construct_inv_mass != 0)
+			moving_bodies.push_back(bVector[i]);
+		else if(is_plane(bVector[i]))
+			planes.push_back(bVector[i]);
+		else
+			static_bodies.push_back(bVector[i]);
+	}
+	slot_of.resize(size);
+	static_tree.rebuild(static_bodies);
+
+	curr_pos.resize(size_pos());
+	curr_vel.resize(size_vel());
+	graph_pos.resize(size_pos());
+	graph_vel.resize(size_vel());
+	top_sorted.reserve(size);
+	tarjan_stack.reserve(size);
 }
 
 System::~System(void)
 {
+    bVector.clear();
+	store.clear();
+	delete broadphase;
+	set_num_threads(1);
+}
+
+void System::set_num_threads(int num_threads)
+{
+	delete workers;
+	workers = num_threads > 1 ? new WorkerPool(num_threads) : NULL;
+
+	thread_scratch.resize(workers ? workers->num_threads() : 0);
+}
+
+int System::num_threads() const
+{
+	return workers ? workers->num_threads() : 1;
+}
+
+/**
+ * Replaces the broadphase used by the collision and contact passes.
+ * The system takes ownership of it. NULL makes the passes test every pair.
+ **/
+void System::set_broadphase(Broadphase* i_broadphase)
+{
+	delete broadphase;
+	broadphase = i_broadphase;
+}
+
+/**
+ * Refits the broadphase to the current state of the moving bodies
+ * and records where each body sits in bVector.
+ **/
+void System::refit_broadphase(real_t dt)
+{
+	update_slots();
+	if(broadphase)
+		broadphase->update(moving_bodies, dt);
+}
+
+/**
+ * Fills candidate_pairs with the pairs of slots whose boxes overlapped at the
+ * last refit_broadphase, as (smaller slot, larger slot) and sorted so they are
+ * visited in the same order as the full pair loop. Moving bodies are paired
+ * with each other by the broadphase and with the static bodies by the static tree.
+ **/
+void System::find_candidate_pairs(real_t dt)
+{
+	broadphase->get_pairs(broadphase_pairs);
+
+	AABB box;
+	std::vector<Body*> &statics = main_scratch.candidate_bodies;
+	for(int n = 0; n < moving_bodies.size(); ++n){
+		Body *b = moving_bodies[n];
+		get_fat_aabb(b, dt, box);
+		statics.clear();
+		static_tree.query(box, statics);
+		for(int m = 0; m < statics.size(); ++m)
+			broadphase_pairs.push_back(BodyPair(statics[m], b));
+		for(int m = 0; m < planes.size(); ++m)
+			broadphase_pairs.push_back(BodyPair(planes[m], b));
+	}
+	statics.clear();
+
+	candidate_pairs.clear();
+	for(int n = 0; n < broadphase_pairs.size(); ++n){
+		int i = slot_of[broadphase_pairs[n].first->id];
+		int k = slot_of[broadphase_pairs[n].second->id];
+		candidate_pairs.push_back(std::make_pair(std::min(i, k), std::max(i, k)));
+	}
+	std::sort(candidate_pairs.begin(), candidate_pairs.end());
+}
+
+/**
+ * Finds the bodies whose boxes overlap the given box as of the last
+ * refit_broadphase, in the order they appear in bVector. The static bodies
+ * are left out unless with_static is set.
+ * Without a broadphase every body is returned.
+ **/
+void System::query_bodies(const AABB &box, std::vector<Body*> &bodies)
+{
+	query_bodies(box, bodies, main_scratch);
+}
+
+void System::query_bodies(const AABB &box, std::vector<Body*> &bodies, PassScratch &scratch, bool with_static)
+{
+	bodies.clear();
+	if(!broadphase){
+		bodies = bVector;
+		return;
+	}
+
+	std::vector<Body*> &candidates = scratch.candidate_bodies;
+	std::vector<std::pair<int, int> > &order = scratch.candidate_order;
+	broadphase->query(box, candidates);
+	if(with_static)
+	{
+		static_tree.query(box, candidates);
+		candidates.insert(candidates.end(), planes.begin(), planes.end());
+	}
+	order.clear();
+	for(int n = 0; n < candidates.size(); ++n){
+		order.push_back(std::make_pair(slot_of[candidates[n]->id], n));
+	}
+	std::sort(order.begin(), order.end());
+	for(int n = 0; n < order.size(); ++n){
+		bodies.push_back(candidates[order[n].second]);
+	}
+	candidates.clear();
+}
+
+void System::step(RBIntegratorType integrator, real_t dt)
+{
+	step_pos.resize(size_pos());
+	step_vel.resize(size_vel());
+	real_t *prev_pos = &step_pos[0];
+	real_t *prev_vel = &step_vel[0];
+
+	// drop the cached contacts of pairs that stopped touching last frame
+	pair_cache.new_frame();
+
+	/***********************/
+	/* collision detection */
+	/***********************/
+
+	// get x and v
 	for(int i = 0; i < size; ++i){
-		delete bVector[i];
+		get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
+		get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
 	}
-    bVector.clear();
-	delete[] curr_pos;
-	delete[] curr_vel;
-	delete[] prev_pos;
-	delete[] prev_vel;
+
+	// set system to x' and v'
+	zero_forces();
+	add_gravity();
+	integrate_vel(integrator, dt);
+	integrate_pos(integrator, dt);
+
+	// find and resolve collisions
+	for(collision_iterations = 0; collision_iterations < MAX_COLLISIONS; collision_iterations++){
+		if(!collsion_detect(integrator, dt, prev_pos, prev_vel))
+			break;
+		// set the system back to x and v where v has collision info
+		for(int i = 0; i < size; ++i){
+			set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
+			set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
+		}
+		// get new x' and v'
+		zero_forces();
+		add_gravity();
+		integrate_vel(integrator, dt);
+		integrate_pos(integrator, dt);
+	}
+
+	// set the system back to x and v where v has final collision info
+	for(int i = 0; i < size; ++i){
+		set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
+		set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
+	}
+
+	// update forces
+	zero_forces();
+	add_gravity();
+
+	/*********************/
+	/* contact detection */
+	/*********************/
+
+	// integrate velocity
+	integrate_vel(integrator, dt);
+
+	create_contact_graph(integrator, dt);
+
+	// Save off current x
+	for(int i = 0; i < size; ++i){
+		get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
+	}
+
+	// Set state to x', v'
+	integrate_pos(integrator, dt);
+
+	// resolve the contacts in the contact graph
+	for(contact_iterations = 0; contact_iterations < MAX_CONTACTS + MAX_SHOCK_PROP; contact_iterations++){
+		if(!contact_detect(integrator, dt, prev_pos, contact_iterations, contact_iterations >= MAX_CONTACTS))
+			break;
+		// Set state back to x, v' now that it has the new v'.
+		for(int i = 0; i < size; ++i){
+			set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
+		}
+		// Set state to the new x', v' before testing for contacts again
+		integrate_pos(integrator, dt);
+	}
+
+	// let the islands which came to rest fall asleep
+	update_sleep(dt);
 }
 
 /**
@@ -55,86 +271,516 @@ void System::add_gravity()
 /**
  * calculates impulse forces and torques for collision detection
  **/
-bool System::collsion_detect(const RBIntegrator* pIntegrator, double dt, double* prev_pos, double* prev_vel)
+bool System::collsion_detect(RBIntegratorType integrator, real_t dt, real_t* prev_pos, real_t* prev_vel)
 {
-	Vec3 p, p1, p2, normal, r1, r2;
-	Body *b1, *b2;
 	bool has_collisions = false;
-	
-    for(int i = 0; i < bVector.size(); ++i){
-		for(int k = i+1; k < bVector.size(); ++k){
-			b1 = bVector[i];
-			b2 = bVector[k];
+
+	if(broadphase)
+	{
+		refit_broadphase(dt);
+		find_candidate_pairs(dt);
+
+		if(workers)
+		{
+			pass.dt = dt;
+			pass.prev_pos = prev_pos;
+			pass.prev_vel = prev_vel;
+			build_islands(candidate_pairs);
+			return run_islands(integrator, collide_island_task);
+		}
+
+		for(int n = 0; n < candidate_pairs.size(); ++n){
+			if(collide_pair(integrator, dt, prev_pos, prev_vel, candidate_pairs[n].first, candidate_pairs[n].second))
+				has_collisions = true;
+		}
+	}
+	else
+	{
+		for(int i = 0; i < bVector.size(); ++i){
+			for(int k = i+1; k < bVector.size(); ++k){
+				if(collide_pair(integrator, dt, prev_pos, prev_vel, i, k))
+					has_collisions = true;
+			}
+		}
+	}
+
+	return has_collisions;
+}
+
+/**
+ * Tests bodies i and k for intersection and resolves the collision if there is one.
+ * Returns true if an impulse was applied.
+ **/
+bool System::collide_pair(RBIntegratorType integrator, real_t dt, real_t* prev_pos, real_t* prev_vel, int i, int k)
+{
+	ContactSet contacts;
+	Body *b1 = bVector[i];
+	Body *b2 = bVector[k];
+	bool has_collision = false;
+
+	if(!pair_is_active(b1, b2))
+		return false;
+
+	// A fast pair can end the step apart on the far side of each other, or
+	// overlapping from the far side so the contact at x' pushes the wrong way.
+	// Such pairs are resolved where they first touch during the step instead.
+	bool swept = false;
+	if(ccd_enabled && needs_sweep(b1, b2, prev_pos + i*POS_STATE_SIZE, prev_pos + k*POS_STATE_SIZE))
+	{
+		real_t toi;
+		swept = time_of_impact(i, k, prev_pos, toi, contacts);
+		if(swept)
+		{
+			if(b1->construct_inv_mass != 0)
+				set_sweep_pose(i, prev_pos, toi);
+			if(b2->construct_inv_mass != 0)
+				set_sweep_pose(k, prev_pos, toi);
+		}
+	}
+
+	if(swept || narrowphase(b1, b2, contacts))
+	{
+		// a sleeping body hit by an awake one has to move again
+		wake(b1);
+		wake(b2);
+
+		// static bodies never change, and leaving them alone means the
+		// islands solved on other threads never write to the same body
+		int moving[2];
+		int num_moving = 0;
+		if(b1->construct_inv_mass != 0)
+			moving[num_moving++] = i;
+		if(b2->construct_inv_mass != 0)
+			moving[num_moving++] = k;
+
+		// set the system back to the x', v state to apply collision forces
+		for(int n = 0; n < num_moving; ++n){
+			get_state_vel(&curr_vel[0] + moving[n]*VEL_STATE_SIZE, moving[n]);
+			set_state_vel(prev_vel + moving[n]*VEL_STATE_SIZE, moving[n]);
+		}
+		
+		if(resolve_manifold(b1, b2, contacts, -1, false))
+		{
+			has_collision = true;
+		}
+
+		for(int n = 0; n < num_moving; ++n){
+			int m = moving[n];
+			// Save off the new v state
+			get_state_vel(prev_vel + m*VEL_STATE_SIZE, m);
+
+			if(has_collision)
+			{
+				// Update the x' for the bodies in this collision
+				set_state_pos(prev_pos + m*POS_STATE_SIZE, m);
+				integrate_body_vel(integrator, dt, m);
+				integrate_body_pos(integrator, dt, m);
+			}
+			else if(swept)
+			{
+				// move the body back to the end of the step
+				set_state_pos(&curr_pos[0] + m*POS_STATE_SIZE, m);
+			}
+
+			// reset the system to x', v' for the rest of the collisions to be resolved
+			set_state_vel(&curr_vel[0] + m*VEL_STATE_SIZE, m);
+		}
+	}
+
+	return has_collision;
+}
+
+/**
+ * Tests bodies b1 and b2 for intersection. On a hit contacts holds the world
+ * contact points on each body and a normal pointing from b1 to b2. The result
+ * is taken from the pair cache if neither body has moved relative to the
+ * other since the pair was last tested.
+ **/
+bool System::narrowphase(Body *b1, Body *b2, ContactSet &contacts)
+{
+	// bodies whose bounding spheres are apart never reach the cache,
+	// planes have no bounding sphere
+	if(!is_plane(b1) && !is_plane(b2) && norm(b2->Position - b1->Position) > b1->radius + b2->radius)
+		return false;
+
+	// the manifold is stored relative to the body with the smaller id
+	bool swapped = b1->id > b2->id;
+	Body *first = swapped ? b2 : b1;
+	Body *second = swapped ? b1 : b2;
+	ContactManifold *cached = pair_cache.lookup(first, second);
+	if(!cached)
+	{
+		// the islands' pairs were added before the threads started, any other
+		// pair found during a parallel pass is tested without the cache
+		if(in_parallel_pass)
+		{
+			__sync_fetch_and_add(&pair_cache.num_tests, 1);
+			return collide(b1, b2, contacts);
+		}
+		cached = &pair_cache.get(first, second);
+	}
+	ContactManifold &m = *cached;
+
+	if(pair_cache.is_current(m, first, second))
+	{
+		__sync_fetch_and_add(&pair_cache.num_hits, 1);
+	}
+	else
+	{
+		__sync_fetch_and_add(&pair_cache.num_tests, 1);
+		bool touching = collide(first, second, contacts, pair_cache.seed_tests ? &m.mpr : NULL);
+		pair_cache.store(m, first, second, touching, contacts.p1, contacts.p2, contacts.num_points, contacts.normal);
+	}
+
+	if(!m.touching)
+		return false;
+
+	contacts.num_points = m.num_points;
+	contacts.normal = m.get_world_normal(first);
+	for(int c = 0; c < m.num_points; ++c){
+		m.get_world_points(first, second, c, contacts.p1[c], contacts.p2[c]);
+	}
+	if(swapped)
+	{
+		for(int c = 0; c < m.num_points; ++c)
+			std::swap(contacts.p1[c], contacts.p2[c]);
+		contacts.normal = -contacts.normal;
+	}
+	return true;
+}
+
+/**
+ * Applies the impulse the collision pass would for a single contact between
+ * b1 and b2 at r1 and r2 from their centres, with normal pointing from b1 to
+ * b2. Returns true if the bodies were approaching there.
+ **/
+bool System::resolve_collision(Body *b1, Body *b2, const Vec3 &r1, const Vec3 &r2, const Vec3 &normal)
+{
+	return resolve_collisions(b1, b2, r1, r2, normal, -1, false);
+}
+
+/**
+ * returns true if bodies b1 and b2 intersect. Unlike narrowphase() nothing is
+ * stored in the pair cache, but the test is still started from the pair's
+ * cached search direction when there is one. The test runs on a copy of the
+ * direction, so the cache is only read.
+ **/
+bool System::test_intersection(Body *b1, Body *b2)
+{
+	ContactSet contacts;
+	Body *first = b1->id < b2->id ? b1 : b2;
+	Body *second = b1->id < b2->id ? b2 : b1;
+	const ContactManifold *m = pair_cache.seed_tests ? pair_cache.find(first, second) : NULL;
+	if(!m)
+		return collide(first, second, contacts, NULL);
+	MPRCache seed = m->mpr;
+	return collide(first, second, contacts, &seed);
+}
+
+/**
+ * The position stored in a position state.
+ **/
+static Vec3 state_position(const real_t *x)
+{
+	return Vec3(x[0], x[1], x[2]);
+}
+
+/**
+ * The orientation stored in a position state.
+ **/
+static Quaternion state_orientation(const real_t *x)
+{
+	return Quaternion(x[3], x[4], x[5], x[6]);
+}
+
+/**
+ * returns the angle of the rotation which takes orientation q0 to q1
+ **/
+static real_t rotation_angle(const Quaternion &q0, const Quaternion &q1)
+{
+	Quaternion rel = conjugate(q0)*q1;
+	real_t s = sqrt(rel.x*rel.x + rel.y*rel.y + rel.z*rel.z);
+	return 2.0*atan2(s, fabs(rel.w));
+}
+
+/**
+ * returns true if bodies b1 and b2, which are apart at x', close in on each other
+ * fast enough during the step that they could have passed through each other.
+ * pos1 and pos2 are the states of the bodies at the start of the step.
+ **/
+bool System::needs_sweep(const Body *b1, const Body *b2, const real_t *pos1, const real_t *pos2) const
+{
+	// nothing passes through a half space, a body below the plane still touches it
+	if(is_plane(b1) || is_plane(b2))
+		return false;
+
+	Vec3 motion = (b2->Position - state_position(pos2)) - (b1->Position - state_position(pos1));
+	real_t reach = norm(motion) + rotation_angle(state_orientation(pos1), b1->Orientation)*b1->radius
+	                            + rotation_angle(state_orientation(pos2), b2->Orientation)*b2->radius;
+
+	// the bounding spheres never meet during the step
+	if(norm(b2->Position - b1->Position) - norm(motion) > b1->radius + b2->radius)
+		return false;
+
+	real_t thinnest = std::min(std::min(b1->size[0], b1->size[1]), b1->size[2]);
+	thinnest = std::min(thinnest, std::min(std::min(b2->size[0], b2->size[1]), b2->size[2]));
+	return reach > CCD_MOTION_FRACTION*0.5*thinnest;
+}
+
+/**
+ * Moves the body in slot i to the fraction t of the way through the step,
+ * from its state in prev_pos at the start to its state in curr_pos at the end.
+ * Positions are interpolated linearly and orientations at a constant angular speed.
+ **/
+void System::set_sweep_pose(int i, const real_t *prev_pos, real_t t)
+{
+	const real_t *x0 = prev_pos + i*POS_STATE_SIZE;
+	const real_t *x1 = &curr_pos[0] + i*POS_STATE_SIZE;
+	real_t x[POS_STATE_SIZE];
+	for(int k = 0; k < 3; ++k)
+		x[k] = x0[k] + t*(x1[k] - x0[k]);
+
+	Quaternion q = slerp(state_orientation(x0), state_orientation(x1), t);
+
+	x[3] = q.w;
+	x[4] = q.x;
+	x[5] = q.y;
+	x[6] = q.z;
+	set_state_pos(x, i);
+}
+
 #if USE_XENOCOLLIDE
-			if(Body::intersection_test(b1, b2, p1, p2, normal))
-#else
-			if(b1->intersection_test(b2, p, normal))
+/**
+ * Finds the point of the body furthest along the world direction dir.
+ **/
+static Vec3 support_point(const Body *b, const Vec3 &dir)
+{
+	Vec3 v = b->cold->model->GetSupportPoint(conjugate(b->Orientation)*dir);
+	b->TransformBodyToWorld(v);
+	return v;
+}
+
+/**
+ * returns how far apart b1 and b2 are along the unit axis, which points from b2
+ * to b1. The result is a lower bound on the distance between the bodies if it
+ * is positive, otherwise the axis does not separate them.
+ **/
+static real_t separation(const Body *b1, const Body *b2, const Vec3 &axis)
+{
+	return -((support_point(b2, axis) - support_point(b1, -axis))*axis);
+}
+
+/**
+ * A single contact between b1 and b2 where they are gap apart along the axis.
+ * The point is taken from the smaller body, which makes it land on the
+ * feature that touches rather than in the middle of a large face.
+ **/
+static void sweep_contact(const Body *b1, const Body *b2, const Vec3 &axis, real_t gap, ContactSet &contacts)
+{
+	if(b1->radius < b2->radius)
+	{
+		contacts.p1[0] = support_point(b1, -axis);
+		contacts.p2[0] = contacts.p1[0] - gap*axis;
+	}
+	else
+	{
+		contacts.p2[0] = support_point(b2, axis);
+		contacts.p1[0] = contacts.p2[0] + gap*axis;
+	}
+	contacts.normal = -axis;
+	contacts.num_points = 1;
+}
 #endif
+
+/**
+ * Conservative advancement of the bodies in slots i and k from their state in
+ * prev_pos to their current state, x'. The bodies are stepped forward by the
+ * gap along a separating axis over the fastest the gap could close, which can
+ * never step past the first touch. Each axis is kept while it still separates
+ * the bodies and a new one is found with XenoCollide when it stops working.
+ * On a hit toi is the fraction of the step at which the bodies touch and
+ * contacts holds the contact there. The bodies are left at x'.
+ **/
+bool System::time_of_impact(int i, int k, const real_t *prev_pos, real_t &toi, ContactSet &contacts)
+{
+#if USE_XENOCOLLIDE
+	Body *b1 = bVector[i];
+	Body *b2 = bVector[k];
+	const real_t *start1 = prev_pos + i*POS_STATE_SIZE;
+	const real_t *start2 = prev_pos + k*POS_STATE_SIZE;
+	bool moving1 = b1->construct_inv_mass != 0;
+	bool moving2 = b2->construct_inv_mass != 0;
+
+	// static bodies stay where they are, so only the moving ones are swept
+	if(moving1)
+		get_state_pos(&curr_pos[0] + i*POS_STATE_SIZE, i);
+	if(moving2)
+		get_state_pos(&curr_pos[0] + k*POS_STATE_SIZE, k);
+
+	// how fast the gap along an axis can close, per whole step
+	Vec3 motion = (b2->Position - state_position(start2)) - (b1->Position - state_position(start1));
+	real_t spin = rotation_angle(state_orientation(start1), b1->Orientation)*b1->radius
+	            + rotation_angle(state_orientation(start2), b2->Orientation)*b2->radius;
+
+	MPRCache cache;
+	Vec3 axis;
+	real_t gap = 0.0;
+	real_t t = 0.0;
+	bool hit = false;
+	bool mpr_contact = false;
+	for(int iter = 0; ; ++iter)
+	{
+		if(moving1)
+			set_sweep_pose(i, prev_pos, t);
+		if(moving2)
+			set_sweep_pose(k, prev_pos, t);
+
+		// try the last axis before searching for a new one
+		if(cache.valid)
+		{
+			axis = b1->Orientation*cache.local_dir;
+			unitize(axis);
+			gap = separation(b1, b2, axis);
+		}
+		if(!cache.valid || gap <= 0.0)
+		{
+			Vec3 p1, p2, normal;
+			cache.valid = false;
+			if(Body::intersection_test(b1, b2, p1, p2, normal, &cache))
 			{
-#if USE_XENOCOLLIDE	
-				// get the relative position of the collision points in the x', v' frame
-				r1 = p1 - b1->Position;
-				r2 = p2 - b2->Position;
-				// The intersection test returns a normal relative to b2,
-				// but the collision resolution uses a normal relative to b1.
-				normal = -normal;
+				// bodies which overlap from the start are left to the contact pass
+				hit = mpr_contact = t > 0.0;
+				contacts.p1[0] = p1;
+				contacts.p2[0] = p2;
+				contacts.normal = -normal;
+				contacts.num_points = 1;
+				break;
+			}
+			if(cache.valid && cache.separating)
+				axis = b1->Orientation*cache.local_dir;
+			else
+				axis = b1->Position - b2->Position;
+			unitize(axis);
+			gap = separation(b1, b2, axis);
+		}
+
+		real_t closing = motion*axis + spin;
+		if(gap < CCD_TOLERANCE || iter + 1 == CCD_MAX_ITERATIONS)
+		{
+			// running out of iterations counts as a hit, it is the safe side to err on
+			hit = true;
+			break;
+		}
+		if(closing <= 0.0 || t + gap / closing >= 1.0)
+		{
+			// the gap can not close before the end of the step
+			break;
+		}
+		t += gap / closing;
+	}
+
+	if(hit && !mpr_contact)
+		sweep_contact(b1, b2, axis, std::max<real_t>(gap, 0.0), contacts);
+
+	if(moving1)
+		set_state_pos(&curr_pos[0] + i*POS_STATE_SIZE, i);
+	if(moving2)
+		set_state_pos(&curr_pos[0] + k*POS_STATE_SIZE, k);
+	toi = t;
+	return hit;
 #else
-				// get the relative position of the collision points in the x', v' frame
-				r1 = p - b1->Position;
-				r2 = p - b2->Position;
+	return false;
 #endif
-				
-				// set the system back to the x', v state to apply collision forces
-				get_state_vel(curr_vel + i*VEL_STATE_SIZE, i);
-				get_state_vel(curr_vel + k*VEL_STATE_SIZE, k);
-				set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-				set_state_vel(prev_vel + k*VEL_STATE_SIZE, k);
-				
-				if(resolve_collisions(b1, b2, r1, r2, normal, -1, false))
-				{
-					has_collisions = true;
-					
-					// Save off the new v state
-					get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-					get_state_vel(prev_vel + k*VEL_STATE_SIZE, k);
-					
-					// Update the x' for the bodies in this collision
-					set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-					set_state_pos(prev_pos + k*POS_STATE_SIZE, k);
-					pIntegrator->integrate_vel(*this, dt, i);
-					pIntegrator->integrate_vel(*this, dt, k);
-					pIntegrator->integrate_pos(*this, dt, i);
-					pIntegrator->integrate_pos(*this, dt, k);
-				}
-				else
-				{
-					// Save off the new v state
-					get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-					get_state_vel(prev_vel + k*VEL_STATE_SIZE, k);
-				}
-				
-                // reset the system to x', v' for the rest of the collisions to be resolved
-				set_state_vel(curr_vel + i*VEL_STATE_SIZE, i);
-				set_state_vel(curr_vel + k*VEL_STATE_SIZE, k);
-			}
-        }
-    }
+}
 
-	return has_collisions;
+/**
+ * returns true if a pair of bodies needs to be tested, which is
+ * when at least one of them is awake and not static
+ **/
+bool System::pair_is_active(const Body *b1, const Body *b2) const
+{
+	return (!b1->asleep && b1->construct_inv_mass != 0) || (!b2->asleep && b2->construct_inv_mass != 0);
+}
+
+/**
+ * Records where each body currently sits in bVector since
+ * the list is reordered by the contact graph every frame.
+ **/
+void System::update_slots()
+{
+	for(int i = 0; i < size; ++i){
+		slot_of[bVector[i]->id] = i;
+	}
 }
 
 /**
  * calculates impulse forces and torques for contact detection
  **/
-bool System::contact_detect(const RBIntegrator* pIntegrator, double dt, double* prev_pos, int iter, bool is_shock_prop)
+bool System::contact_detect(RBIntegratorType integrator, real_t dt, real_t* prev_pos, int iter, bool is_shock_prop)
+{
+	bool has_contacts;
+
+	refit_broadphase(dt);
+	if(workers && broadphase)
+	{
+		find_candidate_pairs(dt);
+
+		pass.dt = dt;
+		pass.prev_pos = prev_pos;
+		pass.iter = iter;
+		pass.is_shock_prop = is_shock_prop;
+		build_islands(candidate_pairs);
+		has_contacts = run_islands(integrator, contact_island_task);
+	}
+	else
+	{
+		has_contacts = contact_sweep(integrator, dt, prev_pos, iter, is_shock_prop, all_slots, -1, main_scratch);
+	}
+	
+	// reset the masses and synch the momentum with
+	// the velocity if shock propagation was used
+	if(is_shock_prop)
+	{
+		for(int i = 0; i < size; ++i)
+		{
+			Body* b = bVector[i];
+			b->inv_mass = b->construct_inv_mass;
+			b->Iinv = b->R * b->Iinv_body * b->R_t;
+			b->invalidate_omega();
+			if(!IsZero(b->inv_mass))
+			{
+				b->Momentum = b->Velocity / b->inv_mass;
+				Matrix3 I;
+				inverse(&I, b->Iinv);
+				b->AngularMomentum = I * b->Omega;
+			}
+		}
+	}
+	
+	return has_contacts;
+}
+
+/**
+ * Runs the contact pass over the bodies in the given slots, which must be in
+ * sorted order. Each strongly connected component of the contact graph is
+ * iterated up to LEVEL_ITER times before moving on to the next one. If island
+ * is not -1 only the bodies of that island and static bodies are tested.
+ **/
+bool System::contact_sweep(RBIntegratorType integrator, real_t dt, real_t* prev_pos, int iter, bool is_shock_prop,
+                           const std::vector<int> &sweep, int island, PassScratch &scratch)
 {
-	Vec3 r1, r2, p, p1, p2, normal;
+	ContactSet contacts;
 	Body *b1, *b2;
 	bool has_contacts = false;
 	bool had_contact_this_iter = false;
-	int count = 0, cur_SCC = 0, SCC_head_body = 0;
-	for(int i = 0; i < size || count < LEVEL_ITER; ++i){
-		if(i == size || bVector[i]->SCC_num != cur_SCC)
+	int num = sweep.size();
+	int count = 0, SCC_head_body = 0;
+	int cur_SCC = num > 0 ? bVector[sweep[0]]->cold->SCC_num : 0;
+	AABB box;
+	std::vector<Body*> &neighbours = scratch.neighbours;
+
+	for(int p = 0; p < num || count < LEVEL_ITER; ++p){
+		if(p == num || bVector[sweep[p]]->cold->SCC_num != cur_SCC)
 		{ // Reached the last body in the current strongly connected component
 			count++;
 			
@@ -142,7 +788,7 @@ bool System::contact_detect(const RBIntegrator* pIntegrator, double dt, double*
 			{ // Move onto the next strongly connected component if this is the max number of iterations per level
 			  // or if we already did one iteration and found no contacts.
 
-				if(i == size)
+				if(p == num)
 				{ // This was the last SCC so just end the loop
 					break;
 				}
@@ -151,84 +797,225 @@ bool System::contact_detect(const RBIntegrator* pIntegrator, double dt, double*
 				// on to the next level if applying shock propagation
 				if(is_shock_prop)
 				{
-					for(int k = SCC_head_body; k < i; ++k)
+					for(int q = SCC_head_body; q < p; ++q)
 					{
-						Body *b = bVector[k];
+						Body *b = bVector[sweep[q]];
+						if(b->construct_inv_mass == 0)
+							continue;
 						b->inv_mass = 0;
+						b->invalidate_derived();
 						b->Iinv = Matrix3(Vec3(0,0,0), Vec3(0,0,0), Vec3(0,0,0));
 					}
 				}
 
-				cur_SCC++;
-				SCC_head_body = i;
+				cur_SCC = bVector[sweep[p]]->cold->SCC_num;
+				SCC_head_body = p;
 				count = 0;
 			}
 			else if(count < LEVEL_ITER)
 			{ // Move on to the next iteration through this strongly connected component
-				i = SCC_head_body;
+				p = SCC_head_body;
 			}
 			
 			had_contact_this_iter = false;
 		}
 		
+		int i = sweep[p];
 		b1 = bVector[i];
-		for(int k = i - 1; k >= 0; --k){
-			b2 = bVector[k];
+		// a static body only has to look for the moving bodies near it
+		get_fat_aabb(b1, dt, box);
+		query_bodies(box, neighbours, scratch, b1->construct_inv_mass != 0);
 
-#if USE_XENOCOLLIDE
-			if(Body::intersection_test(b1, b2, p1, p2, normal))
-#else
-			if(b1->intersection_test(b2, p, normal))
-#endif
+		// only test against the bodies before this one in the sorted order
+		for(int n = neighbours.size() - 1; n >= 0; --n){
+			b2 = neighbours[n];
+			int k = slot_of[b2->id];
+			// another island's bodies are being written by another thread, so
+			// they are left alone before anything of theirs is read
+			if(island >= 0 && b2->construct_inv_mass != 0 && island_of[k] != island)
+				continue;
+			if(k >= i || !pair_is_active(b1, b2))
+				continue;
+
+			if(narrowphase(b1, b2, contacts))
 			{
-#if USE_XENOCOLLIDE	
-				// get the relative position of the collision points in the x', v' frame (TODO: make this in the x, v' frame)
-				r1 = p1 - b1->Position;
-				r2 = p2 - b2->Position;
-				// The intersection test returns a normal relative to b2,
-				// but the collision resolution uses a normal relative to b1.
-				normal = -normal;
-#else
-				// get the relative position of the collision points in the x', v' frame
-				r1 = p - b1->Position;
-				r2 = p - b2->Position;
-#endif
+				wake(b1);
+				wake(b2);
 
-				had_contact_this_iter = resolve_collisions(b1, b2, r1, r2, normal, iter, true) || had_contact_this_iter;
-				has_contacts = had_contact_this_iter || has_contacts;
+				if(resolve_manifold(b1, b2, contacts, iter, true))
+				{
+					had_contact_this_iter = true;
+					has_contacts = true;
+				}
 				
 				if(had_contact_this_iter)
 				{
 					// Update the x' for the bodies in this collision
-					set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-					set_state_pos(prev_pos + k*POS_STATE_SIZE, k);
-					pIntegrator->integrate_pos(*this, dt, i);
-					pIntegrator->integrate_pos(*this, dt, k);
+					if(b1->construct_inv_mass != 0)
+					{
+						set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
+						integrate_body_pos(integrator, dt, i);
+					}
+					if(b2->construct_inv_mass != 0)
+					{
+						set_state_pos(prev_pos + k*POS_STATE_SIZE, k);
+						integrate_body_pos(integrator, dt, k);
+					}
 				}
 			}
 		}
 	}
 	
-	// reset the masses and synch the momentum with
-	// the velocity if shock propagation was used
-	if(is_shock_prop)
-	{
-		for(int i = 0; i < size; ++i)
+	return has_contacts;
+}
+
+/**
+ * Splits the bodies into islands joined by the given candidate pairs and by
+ * the contact graph. Static bodies belong to no island, since joining
+ * through them would put everything resting on the floor in one island.
+ **/
+void System::build_islands(const std::vector<std::pair<int, int> > &pairs)
+{
+	island_parent.resize(size);
+	for(int i = 0; i < size; ++i){
+		island_parent[i] = i;
+	}
+
+	for(int n = 0; n < pairs.size(); ++n){
+		int i = pairs[n].first, k = pairs[n].second;
+		if(bVector[i]->construct_inv_mass != 0 && bVector[k]->construct_inv_mass != 0)
+			island_parent[find_island(i)] = find_island(k);
+	}
+	for(int i = 0; i < size; ++i){
+		Body *b = bVector[i];
+		if(b->construct_inv_mass == 0)
+			continue;
+		for(int n = 0; n < b->in_contact_list.size(); ++n){
+			Body *other = b->in_contact_list[n];
+			if(other->construct_inv_mass != 0)
+				island_parent[find_island(i)] = find_island(slot_of[other->id]);
+		}
+	}
+
+	// number the islands in slot order, reusing the storage of the last pass
+	island_of.assign(size, -1);
+	num_islands = 0;
+	for(int i = 0; i < size; ++i){
+		Body *b = bVector[i];
+		if(b->construct_inv_mass == 0)
+			continue;
+
+		int root = find_island(i);
+		if(island_of[root] < 0)
 		{
-			Body* b = bVector[i];
-			b->inv_mass = b->construct_inv_mass;
-			b->Iinv = b->R * b->Iinv_body * b->R_t;
-			if(!IsZero(b->inv_mass))
-			{
-				b->Momentum = b->Velocity / b->inv_mass;
-				Matrix3 I;
-				inverse(&I, b->Iinv);
-				b->AngularMomentum = I * b->Omega;
-			}
+			if(num_islands == islands.size())
+				islands.push_back(Island());
+			Island &island = islands[num_islands];
+			island.sweep.clear();
+			island.pairs.clear();
+			island.num_bodies = 0;
+			island.has_awake = false;
+			island.found = false;
+			island_of[root] = num_islands++;
 		}
+		island_of[i] = island_of[root];
+		Island &island = islands[island_of[i]];
+		island.num_bodies++;
+		island.has_awake = island.has_awake || !b->asleep;
+	}
+
+	// hand each pair to the island of its moving body and collect
+	// the static bodies each island can touch
+	for(int n = 0; n < pairs.size(); ++n){
+		int i = pairs[n].first, k = pairs[n].second;
+		if(!pair_is_active(bVector[i], bVector[k]))
+			continue;
+		Island &island = islands[island_of[i] >= 0 ? island_of[i] : island_of[k]];
+		island.pairs.push_back(pairs[n]);
+		if(island_of[i] < 0)
+			island.sweep.push_back(i);
+		if(island_of[k] < 0)
+			island.sweep.push_back(k);
+	}
+	for(int i = 0; i < size; ++i){
+		if(island_of[i] >= 0)
+			islands[island_of[i]].sweep.push_back(i);
+	}
+
+	island_tasks.clear();
+	for(int n = 0; n < num_islands; ++n){
+		Island &island = islands[n];
+		if(!island.has_awake)
+			continue;
+		std::sort(island.sweep.begin(), island.sweep.end());
+		island.sweep.erase(std::unique(island.sweep.begin(), island.sweep.end()), island.sweep.end());
+		island_tasks.push_back(n);
+	}
+
+	// start the biggest islands first so no thread is left with one at the end
+	std::vector<std::pair<int, int> > order;
+	for(int n = 0; n < island_tasks.size(); ++n){
+		order.push_back(std::make_pair(-islands[island_tasks[n]].num_bodies, island_tasks[n]));
+	}
+	std::sort(order.begin(), order.end());
+	for(int n = 0; n < order.size(); ++n){
+		island_tasks[n] = order[n].second;
+	}
+}
+
+/**
+ * Solves the islands found by build_islands on the worker pool with the given task.
+ * Returns true if any island applied an impulse.
+ **/
+bool System::run_islands(RBIntegratorType integrator, WorkerPool::TaskFunc task)
+{
+	// every pair the islands test has to be in the pair cache before the
+	// threads start, since adding to it is not safe while they run
+	for(int t = 0; t < island_tasks.size(); ++t){
+		const Island &island = islands[island_tasks[t]];
+		for(int n = 0; n < island.pairs.size(); ++n){
+			pair_cache.get(bVector[island.pairs[n].first], bVector[island.pairs[n].second]);
+		}
+	}
+
+	pass.integrator = integrator;
+
+	in_parallel_pass = true;
+	workers->run(task, this, island_tasks.size());
+	in_parallel_pass = false;
+
+	bool found = false;
+	for(int t = 0; t < island_tasks.size(); ++t){
+		found = found || islands[island_tasks[t]].found;
+	}
+	return found;
+}
+
+/**
+ * Runs the collision pass over the pairs of one island.
+ **/
+void System::collide_island_task(void *data, int task, int thread)
+{
+	System *sys = (System *) data;
+	Island &island = sys->islands[sys->island_tasks[task]];
+	island.found = false;
+	for(int n = 0; n < island.pairs.size(); ++n){
+		if(sys->collide_pair(sys->pass.integrator, sys->pass.dt, sys->pass.prev_pos, sys->pass.prev_vel,
+		                     island.pairs[n].first, island.pairs[n].second))
+			island.found = true;
 	}
-	
-	return has_contacts;
+}
+
+/**
+ * Runs the contact pass over the bodies of one island.
+ **/
+void System::contact_island_task(void *data, int task, int thread)
+{
+	System *sys = (System *) data;
+	int index = sys->island_tasks[task];
+	Island &island = sys->islands[index];
+	island.found = sys->contact_sweep(sys->pass.integrator, sys->pass.dt, sys->pass.prev_pos, sys->pass.iter,
+	                                  sys->pass.is_shock_prop, island.sweep, index, sys->thread_scratch[thread]);
 }
 
 /**
@@ -242,40 +1029,25 @@ bool System::contact_detect(const RBIntegrator* pIntegrator, double dt, double*
  **/
 bool System::resolve_collisions(Body *b1, Body *b2, Vec3 r1, Vec3 r2, Vec3 normal, int iter, bool is_contact)
 {	
-	Matrix3 K = b1->get_K(r1) + b2->get_K(r2);
-	Matrix3 K_inv;
-	inverse(&K_inv, K);
 	Vec3 u_rel = b2->get_vel(r2) - b1->get_vel(r1);
 	
 	// check if bodies are non-separating in the current timestep
 	if(u_rel*normal >= 0.0){
 		return false; // non-separating, no contact
 	}
+
+	SymMat3 K = b1->get_K(r1) + b2->get_K(r2);
+	SymMat3 K_inv;
+	inverse(&K_inv, K);
 	
-	// has_collisions = true;
-	double restitution;
-	if(is_contact)
-	{
-		if(iter > 4)
-		{ // gradually reduce speed
-			restitution = 0.0;
-		}
-		else
-		{
-			restitution = -.2*(4-iter);
-		}
-	}
-	else
-	{
-		restitution = std::min(b1->restitution, b2->restitution);
-	}
+	real_t restitution = pair_restitution(b1, b2, iter, is_contact);
 
-    double friction = std::min(b1->coef_friction, b2->coef_friction);
+    real_t friction = std::min(b1->coef_friction, b2->coef_friction);
 
+    Vec3 j;
     // check if static friction should be used
     Vec3 j_static = K_inv*(-restitution*(u_rel*normal)*normal - u_rel);
-    double j_static_dot_normal = j_static*normal;
-	Vec3 j;
+    real_t j_static_dot_normal = j_static*normal;
 
     if(norm(j_static - (j_static_dot_normal)*normal)
      	<= friction*(j_static_dot_normal))
@@ -285,87 +1057,167 @@ bool System::resolve_collisions(Body *b1, Body *b2, Vec3 r1, Vec3 r2, Vec3 norma
     }
 	else
 	{ // use kinetic friction
-        double u_rel_dot_normal = u_rel*normal;
+        real_t u_rel_dot_normal = u_rel*normal;
         Vec3 t = u_rel - (u_rel_dot_normal)*normal;
         unitize(t);
         Vec3 normal_minus_friction_t = normal - friction*t;
-        double j_n = -(restitution + 1)*(u_rel_dot_normal) /
-                    (normal*K*(normal_minus_friction_t));
+        real_t j_n = -(restitution + 1)*(u_rel_dot_normal) /
+                    (normal*(K*normal_minus_friction_t));
         j = (j_n*(normal_minus_friction_t));
     }
 
-    b1->Momentum -= j;
-	b1->Velocity -= j * b1->inv_mass;
-    b2->Momentum += j;
-	b2->Velocity += j * b2->inv_mass;
-    b1->AngularMomentum += cross(r1, -j);
-	b1->Omega += b1->Iinv * cross(r1, -j);
-    b2->AngularMomentum += cross(r2, j);
-	b2->Omega += b2->Iinv * cross(r2, j);
+	apply_impulse(b1, b2, r1, r2, j);
 	return true;
 }
 
+/**
+ * Resolves the contacts between two bodies together. The normal impulses of
+ * all the points are solved for at once by projected Gauss-Seidel, each point
+ * pushing only as hard as is needed on top of what the others already did,
+ * and never pulling. Friction is then applied at each point along what is
+ * left of its sliding velocity, limited by the point's share of the normal
+ * impulse. A lone point is resolved on its own as a collision.
+ * Returns true if an impulse was applied.
+ **/
+bool System::resolve_manifold(Body *b1, Body *b2, const ContactSet &contacts, int iter, bool is_contact)
+{
+	// get the relative position of the collision points in the x', v' frame (TODO: make this in the x, v' frame)
+	if(contacts.num_points == 1)
+	{
+		return resolve_collisions(b1, b2, contacts.p1[0] - b1->Position, contacts.p2[0] - b2->Position,
+		                          contacts.normal, iter, is_contact);
+	}
+
+	const Vec3 &normal = contacts.normal;
+	real_t restitution = pair_restitution(b1, b2, iter, is_contact);
+	Vec3 r1[MAX_CONTACT_POINTS], r2[MAX_CONTACT_POINTS];
+	real_t target[MAX_CONTACT_POINTS], k[MAX_CONTACT_POINTS], lambda[MAX_CONTACT_POINTS];
+	bool approaching = false;
+	for(int c = 0; c < contacts.num_points; ++c)
+	{
+		r1[c] = contacts.p1[c] - b1->Position;
+		r2[c] = contacts.p2[c] - b2->Position;
+		real_t u_n = (b2->get_vel(r2[c]) - b1->get_vel(r1[c]))*normal;
+		target[c] = u_n < 0.0 ? -restitution*u_n : 0.0;
+		k[c] = normal*((b1->get_K(r1[c]) + b2->get_K(r2[c]))*normal);
+		lambda[c] = 0.0;
+		approaching = approaching || u_n < 0.0;
+	}
+	if(!approaching)
+		return false;
+
+	for(int i = 0; i < MANIFOLD_ITERATIONS; ++i)
+	{
+		for(int c = 0; c < contacts.num_points; ++c)
+		{
+			real_t u_n = (b2->get_vel(r2[c]) - b1->get_vel(r1[c]))*normal;
+			real_t l = std::max<real_t>(lambda[c] + (target[c] - u_n) / k[c], 0.0);
+			apply_impulse(b1, b2, r1[c], r2[c], (l - lambda[c])*normal);
+			lambda[c] = l;
+		}
+	}
+
+	real_t friction = std::min(b1->coef_friction, b2->coef_friction);
+	bool applied = false;
+	for(int c = 0; c < contacts.num_points; ++c)
+	{
+		if(lambda[c] <= 0.0)
+			continue;
+		Vec3 u_rel = b2->get_vel(r2[c]) - b1->get_vel(r1[c]);
+		Vec3 t = u_rel - (u_rel*normal)*normal;
+		real_t slide = norm(t);
+		if(slide > EPSILON)
+		{
+			t /= slide;
+			real_t k_t = t*((b1->get_K(r1[c]) + b2->get_K(r2[c]))*t);
+			Vec3 j_t = -std::min(slide / k_t, friction*lambda[c])*t;
+			apply_impulse(b1, b2, r1[c], r2[c], j_t);
+		}
+		applied = true;
+	}
+	return applied;
+}
+
+/**
+ * The coefficient of restitution between two bodies. Contacts start out
+ * letting the bodies keep some of their approach and stop them completely
+ * after the first few iterations, collisions use the smaller of the two
+ * restitutions.
+ **/
+real_t System::pair_restitution(const Body *b1, const Body *b2, int iter, bool is_contact) const
+{
+	if(is_contact)
+	{
+		if(iter > 4)
+		{ // gradually reduce speed
+			return 0.0;
+		}
+		return -.2*(4-iter);
+	}
+	return std::min(b1->cold->restitution, b2->cold->restitution);
+}
+
+/**
+ * Applies the impulse j to b2 at r2 and -j to b1 at r1.
+ **/
+void System::apply_impulse(Body *b1, Body *b2, const Vec3 &r1, const Vec3 &r2, const Vec3 &j)
+{
+	// static bodies are shared by the islands, so they are never written to
+	if(b1->construct_inv_mass != 0)
+	{
+		b1->Momentum -= j;
+		b1->Velocity -= j * b1->inv_mass;
+		b1->AngularMomentum += cross(r1, -j);
+		b1->Omega += b1->Iinv * cross(r1, -j);
+		b1->invalidate_omega();
+	}
+	if(b2->construct_inv_mass != 0)
+	{
+		b2->Momentum += j;
+		b2->Velocity += j * b2->inv_mass;
+		b2->AngularMomentum += cross(r2, j);
+		b2->Omega += b2->Iinv * cross(r2, j);
+		b2->invalidate_omega();
+	}
+}
+
 /**
  * take derivative of position/orientation assuming forces and torques have been calculated already
  **/
-void System::eval_deriv_pos(double xdot[]){
+void System::eval_deriv_pos(real_t xdot[]){
     for(int i = 0; i < bVector.size(); ++i)
-        eval_deriv_pos(xdot + i*POS_STATE_SIZE, i);
+        body_deriv_pos(xdot + i*POS_STATE_SIZE, i);
 }
 
 /* take derivative of vel/ang vel assuming forces and torques have been calculated already */
- void System::eval_deriv_vel(double xdot[]){
+ void System::eval_deriv_vel(real_t xdot[]){
      /* update velocity/angular velocity */
      for(int i = 0; i < bVector.size(); ++i)
-        eval_deriv_vel(xdot + i*VEL_STATE_SIZE, i);
+        body_deriv_vel(xdot + i*VEL_STATE_SIZE, i);
 }
 
-void System::get_state_pos(double x[]) const{
+void System::get_state_pos(real_t x[]) const{
     for(int i = 0; i < bVector.size(); ++i)
-        get_state_pos(x + i*POS_STATE_SIZE, i);
+        body_get_pos(x + i*POS_STATE_SIZE, i);
 }
 
-void System::get_state_vel(double x[]) const{
+void System::get_state_vel(real_t x[]) const{
     for(int i = 0; i < bVector.size(); ++i)
-        get_state_vel(x + i*VEL_STATE_SIZE, i);
+        body_get_vel(x + i*VEL_STATE_SIZE, i);
 }
 
-void System::set_state_pos(const double x[]){
+void System::set_state_pos(const real_t x[]){
     for(int i = 0; i < bVector.size(); ++i)
-        set_state_pos(x + i*POS_STATE_SIZE, i);
+        body_set_pos(x + i*POS_STATE_SIZE, i);
 }
 
-void System::set_state_vel(const double x[]){
+void System::set_state_vel(const real_t x[]){
     for(int i = 0; i < bVector.size(); ++i)
-        set_state_vel(x + i*VEL_STATE_SIZE, i);
+        body_set_vel(x + i*VEL_STATE_SIZE, i);
 }
 
 /* get/set/eval functions for single bodies */
-void System::get_state_pos(double x[], int i) const{
-    Body *b = bVector[i];
-
-	get_state_pos(x, b);
-}
-
-void System::get_state_vel(double x[], int i) const{
-    Body *b = bVector[i];
-
-	get_state_vel(x, b);
-}
-
-void System::set_state_pos(const double x[], int i){
-    Body *b = bVector[i];
-
-	set_state_pos(x, b);
-}
-
-void System::set_state_vel(const double x[], int i){
-    Body *b = bVector[i];
-
-	set_state_vel(x, b);
-}
-
-void System::get_state_pos(double x[], Body *b) const{
+void System::get_state_pos(real_t x[], const Body *b) const{
     // pos
     for(int k = 0; k < 3; ++k)
         x[k] = b->Position[k];
@@ -377,7 +1229,7 @@ void System::get_state_pos(double x[], Body *b) const{
     x[6] = b->Orientation.z;
 }
 
-void System::get_state_vel(double x[], Body *b) const{
+void System::get_state_vel(real_t x[], const Body *b) const{
     // momentum
     for(int k = 0; k < 3; ++k)
         x[k] = b->Momentum[k];
@@ -387,42 +1239,29 @@ void System::get_state_vel(double x[], Body *b) const{
         x[k + 3] = b->AngularMomentum[k];
 }
 
-void System::set_state_pos(const double x[], Body *b){
+void System::set_state_pos(const real_t x[], Body *b){
     // pos
     for(int k = 0; k < 3; ++k)
         b->Position[k] = x[k];
 
-    // orientation
-    b->Orientation.w = x[3];
-    b->Orientation.x = x[4];
-    b->Orientation.y = x[5];
-    b->Orientation.z = x[6];
-
-    // R and R transpose
-    b->Orientation = normalize(b->Orientation);
-    b->Orientation.to_matrix(&(b->R));
-    transpose(&(b->R_t), b->R);
-
-    // world inverse inertia tensor
-    b->Iinv = b->R * b->Iinv_body * b->R_t;
+    // orientation, R, R transpose and the world inverse inertia tensor.
+    // The passes roll bodies back to their last state many times a frame,
+    // so these are only recomputed for an orientation not seen just before
+    b->set_orientation(Quaternion(x[3], x[4], x[5], x[6]));
 }
 
-void System::set_state_vel(const double x[], Body *b){
+void System::set_state_vel(const real_t x[], Body *b){
     // momentum and velocity
     for(int k = 0; k < 3; ++k){
         b->Momentum[k] = x[k];
         b->Velocity[k] = x[k] * b->inv_mass;
     }
 
-    // angular momentum
-    for(int k = 0; k < 3; ++k)
-        b->AngularMomentum[k] = x[k + 3];
-
-    // angular velocity
-    b->Omega = b->Iinv * b->AngularMomentum;
+    // angular momentum and angular velocity
+    b->set_angular_momentum(Vec3(x[3], x[4], x[5]));
 }
 
-void System::eval_deriv_pos( double xdot[], int i){
+void System::body_deriv_pos( real_t xdot[], int i){
     Body* b = bVector[i];
 
     // dx/dt
@@ -438,7 +1277,7 @@ void System::eval_deriv_pos( double xdot[], int i){
     xdot[6] = q_dot.z;
 }
 
-void System::eval_deriv_vel( double xdot[], int i ){
+void System::body_deriv_vel( real_t xdot[], int i ){
     Body* b = bVector[i];
 
      // dp/dt
@@ -450,15 +1289,216 @@ void System::eval_deriv_vel( double xdot[], int i ){
          xdot[k + 3] = b->torques[k];
 }
 
+/**
+ * Collects the slots of the awake bodies.
+ **/
+void System::collect_batch_slots()
+{
+	batch_slots.clear();
+	for(int i = 0; i < size; ++i){
+		if(!bVector[i]->asleep)
+			batch_slots.push_back(i);
+	}
+}
+
+void System::batch_integrate_vel(real_t dt)
+{
+	collect_batch_slots();
+	for(int first = 0; first < batch_slots.size(); first += BATCH_CHUNK){
+		int n = std::min((int) batch_slots.size() - first, BATCH_CHUNK);
+		const int *slots = &batch_slots[first];
+		batch.resize(n);
+		for(int j = 0; j < n; ++j){
+			const Body *b = bVector[slots[j]];
+			for(int k = 0; k < 3; ++k){
+				batch[BATCH_MOMENTUM_X + k][j] = b->Momentum[k];
+				batch[BATCH_ANG_MOMENTUM_X + k][j] = b->AngularMomentum[k];
+				batch[BATCH_FORCE_X + k][j] = b->forces[k];
+				batch[BATCH_TORQUE_X + k][j] = b->torques[k];
+			}
+			batch[BATCH_INV_MASS][j] = b->inv_mass;
+			for(int k = 0; k < 9; ++k)
+				batch[BATCH_IINV + k][j] = b->Iinv.m[k];
+		}
+
+		::batch_integrate_vel(batch, dt);
+
+		for(int j = 0; j < n; ++j){
+			Body *b = bVector[slots[j]];
+			for(int k = 0; k < 3; ++k){
+				b->Momentum[k] = batch[BATCH_MOMENTUM_X + k][j];
+				b->Velocity[k] = batch[BATCH_VEL_X + k][j];
+				b->AngularMomentum[k] = batch[BATCH_ANG_MOMENTUM_X + k][j];
+				b->Omega[k] = batch[BATCH_OMEGA_X + k][j];
+			}
+			// the kernel derives Omega exactly as set_angular_momentum would
+			b->omega_key = b->AngularMomentum;
+			b->omega_valid = true;
+		}
+	}
+}
+
+void System::batch_integrate_pos(real_t dt)
+{
+	collect_batch_slots();
+	for(int first = 0; first < batch_slots.size(); first += BATCH_CHUNK){
+		int n = std::min((int) batch_slots.size() - first, BATCH_CHUNK);
+		const int *slots = &batch_slots[first];
+		batch.resize(n);
+		for(int j = 0; j < n; ++j){
+			const Body *b = bVector[slots[j]];
+			for(int k = 0; k < 3; ++k){
+				batch[BATCH_POS_X + k][j] = b->Position[k];
+				batch[BATCH_VEL_X + k][j] = b->Velocity[k];
+				batch[BATCH_OMEGA_X + k][j] = b->Omega[k];
+			}
+			batch[BATCH_ORIENT_W][j] = b->Orientation.w;
+			batch[BATCH_ORIENT_X][j] = b->Orientation.x;
+			batch[BATCH_ORIENT_Y][j] = b->Orientation.y;
+			batch[BATCH_ORIENT_Z][j] = b->Orientation.z;
+			for(int k = 0; k < 9; ++k)
+				batch[BATCH_IINV_BODY + k][j] = b->Iinv_body.m[k];
+		}
+
+		::batch_integrate_pos(batch, dt);
+
+		for(int j = 0; j < n; ++j){
+			Body *b = bVector[slots[j]];
+			b->invalidate_derived();
+			for(int k = 0; k < 3; ++k)
+				b->Position[k] = batch[BATCH_POS_X + k][j];
+			b->Orientation.w = batch[BATCH_ORIENT_W][j];
+			b->Orientation.x = batch[BATCH_ORIENT_X][j];
+			b->Orientation.y = batch[BATCH_ORIENT_Y][j];
+			b->Orientation.z = batch[BATCH_ORIENT_Z][j];
+			for(int k = 0; k < 9; ++k){
+				b->R.m[k] = batch[BATCH_R + k][j];
+				b->Iinv.m[k] = batch[BATCH_IINV + k][j];
+			}
+			transpose(&(b->R_t), b->R);
+		}
+	}
+}
+
+void System::integrate_vel(RBIntegratorType integrator, real_t dt)
+{
+	if(integrator == RB_EULER){
+		batch_integrate_vel(dt);
+		return;
+	}
+	for(int i = 0; i < size; ++i)
+		integrate_body_vel(integrator, dt, i);
+}
+
+void System::integrate_pos(RBIntegratorType integrator, real_t dt)
+{
+	if(integrator == RB_EULER){
+		batch_integrate_pos(dt);
+		return;
+	}
+	for(int i = 0; i < size; ++i)
+		integrate_body_pos(integrator, dt, i);
+}
+
+void System::integrate_body_vel(RBIntegratorType integrator, real_t dt, int i)
+{
+	RBSteps<System>::integrate_vel(integrator, *this, dt, i);
+}
+
+void System::integrate_body_pos(RBIntegratorType integrator, real_t dt, int i)
+{
+	RBSteps<System>::integrate_pos(integrator, *this, dt, i);
+}
+
+/**
+ * Builds the contact graph for the current state, x and v', and sorts the bodies by it.
+ * Each body is moved along the y-axis by itself and the bodies it then touches are
+ * the ones it rests on. Sleeping bodies keep the lists they had when they fell asleep.
+ **/
+void System::create_contact_graph(RBIntegratorType integrator, real_t dt)
+{
+	real_t y_vel[VEL_STATE_SIZE] = {0};
+	std::vector<Body*> neighbours, moving_neighbours;
+	AABB box;
+
+	// clear contact graph
+	for(int i = 0; i < size; ++i){
+		if(!bVector[i]->asleep)
+			bVector[i]->in_contact_list.clear();
+	}
+
+	// the other bodies stay put while each one is moved, so one grid covers the
+	// whole graph. The static bodies are found through their own tree.
+	grid_bodies.clear();
+	for(int i = 0; i < size; ++i){
+		if(bVector[i]->construct_inv_mass != 0)
+			grid_bodies.push_back(bVector[i]);
+	}
+	contact_grid.build(grid_bodies);
+
+	// create contact graph
+	for(int i = 0; i < size; ++i){
+		Body *b = bVector[i];
+		// static objects should never be considered as resting on anything
+		if(b->inv_mass == 0 || b->asleep)
+			continue;
+
+		// evolve each object along the y-axis while keeping the others stationary and test for intersection
+		get_state_pos(&graph_pos[0] + i*POS_STATE_SIZE, i);
+		get_state_vel(&graph_vel[0] + i*VEL_STATE_SIZE, i);
+
+		// grab the y component of the velocity and keep only that.
+		y_vel[1] = graph_vel[i*VEL_STATE_SIZE + 1];
+		if(y_vel[1] > 0)
+		{
+			// Make sure that the object moves down or else there might
+			// be an object above this one that will then count as being below it.
+			y_vel[1] = -y_vel[1];
+		}
+		else
+		{
+			// Increase the current velocity by a factor of 3 to account for
+			// any increase in velocity due to future contact resolutions.
+			y_vel[1] *= 3;
+		}
+		set_state_vel(y_vel, i);
+		integrate_body_pos(integrator, dt, i);
+
+		Vec3 reach(b->radius, b->radius, b->radius);
+		box.lo = b->Position - reach;
+		box.hi = b->Position + reach;
+		neighbours.clear();
+		static_tree.query(box, neighbours);
+		neighbours.insert(neighbours.end(), planes.begin(), planes.end());
+		contact_grid.query(b->Position, b->radius, moving_neighbours);
+		neighbours.insert(neighbours.end(), moving_neighbours.begin(), moving_neighbours.end());
+		for(int n = 0; n < neighbours.size(); ++n){
+			Body *other = neighbours[n];
+			// add the contact to the bodies list if there is one
+			if(other != b && test_intersection(other, b))
+			{
+				b->in_contact_list.push_back(other);
+			}
+		}
+
+		// Reset this body
+		set_state_pos(&graph_pos[0] + i*POS_STATE_SIZE, i);
+		set_state_vel(&graph_vel[0] + i*VEL_STATE_SIZE, i);
+	}
+
+	// sort bodies based on the new contact graph
+	topological_tarjan();
+}
+
 /**
  * Topologically sorts the objects based on the contact graph.
  * Uses Tarjan's algorithm to condense strongly connected components.
  **/
 void System::topological_tarjan(){
     int index = 0;
-	SCC_num = 0;
+	num_SCCs = 0;
     for(int i = 0; i < size; ++i){
-        if(bVector[i]->index < 0){
+        if(bVector[i]->cold->index < 0){
             strongconnect(bVector[i], index);
         }
     }
@@ -466,8 +1506,8 @@ void System::topological_tarjan(){
 	// copy over the sorted list and reset values used in the function
     for(int i = 0; i < size; i++){
         bVector[i] = top_sorted[i];
-		bVector[i]->index = -1;
-		bVector[i]->lowlink = -1;
+		bVector[i]->cold->index = -1;
+		bVector[i]->cold->lowlink = -1;
     }
 
 	top_sorted.clear();
@@ -478,51 +1518,158 @@ void System::topological_tarjan(){
  * topologically sorted list of bodies.
  **/
 void System::strongconnect(Body *vertex, int &index){
-    vertex->index = index;
-    vertex->lowlink = index;
+    vertex->cold->index = index;
+    vertex->cold->lowlink = index;
     index++;
-    S.push(vertex);
-    vertex->in_stack = true;
+    tarjan_stack.push_back(vertex);
+    vertex->cold->in_stack = true;
     
 	// compare index values with all children
     for(int i = 0; i < vertex->in_contact_list.size(); i++){
         Body* child_vertex = vertex->in_contact_list[i];
-        if(child_vertex->index < 0){ // recurse on child if index is undef
+        if(child_vertex->cold->index < 0){ // recurse on child if index is undef
             strongconnect(child_vertex, index);
-            if(vertex->lowlink > child_vertex->lowlink)
-                vertex->lowlink = child_vertex->lowlink;
+            if(vertex->cold->lowlink > child_vertex->cold->lowlink)
+                vertex->cold->lowlink = child_vertex->cold->lowlink;
         } else{ // otherwise update the lowlink if the vertex is reachable from the child
-            if(child_vertex->in_stack && (vertex->lowlink > child_vertex->index))
-                vertex->lowlink = child_vertex->index;
+            if(child_vertex->cold->in_stack && (vertex->cold->lowlink > child_vertex->cold->index))
+                vertex->cold->lowlink = child_vertex->cold->index;
         }
     }
     
     // check if v is a root node of the SCC
-    if(vertex->lowlink == vertex->index){
+    if(vertex->cold->lowlink == vertex->cold->index){
         Body *tmp_vertex;
         // pop vertices off the stack above the current vertex
         // as those are in a SCC and move them to the sorted list.
-        while((tmp_vertex = S.top()) != vertex){
-            S.pop();
-			tmp_vertex->in_stack = false;
-			tmp_vertex->SCC_num = SCC_num;
+        while((tmp_vertex = tarjan_stack.back()) != vertex){
+            tarjan_stack.pop_back();
+			tmp_vertex->cold->in_stack = false;
+			tmp_vertex->cold->SCC_num = num_SCCs;
             top_sorted.push_back(tmp_vertex);
         }
         // put the current vertex in the SCC as well
-        S.pop();
-		tmp_vertex->in_stack = false;
-		tmp_vertex->SCC_num = SCC_num;
+        tarjan_stack.pop_back();
+		tmp_vertex->cold->in_stack = false;
+		tmp_vertex->cold->SCC_num = num_SCCs;
         top_sorted.push_back(tmp_vertex);
-		SCC_num++;
+		num_SCCs++;
     }
 }
 
+/**
+ * Finds the root of the island holding slot i, halving the path on the way.
+ **/
+int System::find_island(int i)
+{
+	while(island_parent[i] != i){
+		island_parent[i] = island_parent[island_parent[i]];
+		i = island_parent[i];
+	}
+	return i;
+}
+
+/**
+ * Puts islands of resting bodies to sleep. Call once at the end of every frame.
+ * The bodies which rest on each other in the contact graph form an island, and
+ * an island only falls asleep once every body in it has been slower than the
+ * sleep thresholds for SLEEP_TIME, so a stack never sleeps under a moving body.
+ **/
+void System::update_sleep(real_t dt)
+{
+	if(!sleeping_enabled)
+		return;
+
+	update_slots();
+	island_parent.resize(size);
+	island_label.assign(size, -1);
+	island_ready.assign(size, true);
+	for(int i = 0; i < size; ++i){
+		island_parent[i] = i;
+	}
+
+	for(int i = 0; i < size; ++i){
+		Body *b = bVector[i];
+		if(b->construct_inv_mass == 0)
+			continue;
+
+		if(!b->asleep)
+		{
+			if(norm(b->Velocity) < SLEEP_LINEAR_VELOCITY && norm(b->Omega) < SLEEP_ANGULAR_VELOCITY)
+				b->sleep_time += dt;
+			else
+				b->sleep_time = 0.0;
+		}
+
+		// static bodies would join everything resting on the floor into one island
+		for(int n = 0; n < b->in_contact_list.size(); ++n){
+			Body *other = b->in_contact_list[n];
+			if(other->construct_inv_mass != 0)
+				island_parent[find_island(i)] = find_island(slot_of[other->id]);
+		}
+	}
+
+	for(int i = 0; i < size; ++i){
+		Body *b = bVector[i];
+		if(b->construct_inv_mass != 0 && !b->asleep && b->sleep_time < SLEEP_TIME)
+			island_ready[find_island(i)] = false;
+	}
+
+	for(int i = 0; i < size; ++i){
+		Body *b = bVector[i];
+		int root = find_island(i);
+		if(b->construct_inv_mass == 0 || !island_ready[root])
+			continue;
+
+		if(island_label[root] < 0)
+			island_label[root] = next_island++;
+		b->island = island_label[root];
+		if(!b->asleep)
+		{
+			b->asleep = true;
+			b->info_saved = false;
+			b->Velocity = Vec3(0, 0, 0);
+			b->Momentum = Vec3(0, 0, 0);
+			b->Omega = Vec3(0, 0, 0);
+			b->AngularMomentum = Vec3(0, 0, 0);
+			b->invalidate_omega();
+		}
+	}
+}
+
+/**
+ * Wakes a sleeping body along with the rest of the island it fell asleep with.
+ * The bodies keep their sleep time, so an island which is not disturbed
+ * any further falls back asleep at the end of the frame.
+ **/
+void System::wake(Body *b)
+{
+	if(!b->asleep)
+		return;
+
+	// The contact graph of a sleeping island is kept, so the whole of it is
+	// inside the island being solved and the other threads are left alone.
+	const std::vector<int> &slots = in_parallel_pass ? islands[island_of[slot_of[b->id]]].sweep : all_slots;
+	int island = b->island;
+	for(int n = 0; n < slots.size(); ++n){
+		Body *other = bVector[slots[n]];
+		if(other->island == island && other->asleep)
+			other->asleep = false;
+	}
+}
+
 /**
  * Saves the current state of the system in a list which will be sent to the client.
+ * The list is indexed by Body::id. Sleeping bodies do not move, so they are
+ * only written once after they fall asleep.
  **/
 void System::saveOutputData(std::vector<BodyInfo> &bodyData){
     for(int i = 0; i < size; ++i){
-        bVector[i]->getInfo(bodyData[i]);
+        Body *b = bVector[i];
+        if(b->asleep && b->info_saved)
+            continue;
+        b->getInfo(bodyData[b->id]);
+        b->info_saved = b->asleep;
     }
 }
 
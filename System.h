@@ -2,54 +2,287 @@
 
 #include <gfx/vec2.h>
 #include <vector>
-#include <stack>
 #include <stdlib.h>
 #include "Body.h"
 #include "integrator.h"
+#include "AABBTree.h"
+#include "SpatialHash.h"
+#include "PairCache.h"
+#include "WorkerPool.h"
+#include "BatchIntegrator.h"
+#include "BodyStore.h"
 
 #define Ks 100.0f
 #define Kd 100.0f
-#define POS_STATE_SIZE 7
-#define VEL_STATE_SIZE 6
+#define POS_STATE_SIZE RB_POS_SIZE
+#define VEL_STATE_SIZE RB_VEL_SIZE
 #define g 9.8
 
-class System : public IntegrableSystem
+// a body whose speed and angular speed stay below these for SLEEP_TIME seconds may fall asleep
+#define SLEEP_LINEAR_VELOCITY 0.1
+#define SLEEP_ANGULAR_VELOCITY 0.1
+#define SLEEP_TIME 0.5
+
+// pairs which close by more than this fraction of the smaller body's thinnest
+// half extent in a step are swept from their start pose so they can not pass
+// through each other
+#define CCD_MOTION_FRACTION 0.5
+// the sweep stops once the bodies are closer than this
+#define CCD_TOLERANCE 0.005
+#define CCD_MAX_ITERATIONS 32
+
+// the batch integrator copies this many bodies in and out of the body batch
+// at a time, so the batch stays in cache between the copies and the kernels
+#define BATCH_CHUNK 256
+
+// Gauss-Seidel sweeps over the points of a contact manifold per impulse pass
+#define MANIFOLD_ITERATIONS 4
+
+// the most collision passes, contact passes and shock propagation passes
+// System::step runs before it moves on
+#define MAX_COLLISIONS 5
+#define MAX_CONTACTS 5
+#define MAX_SHOCK_PROP 1
+
+// Euler integration of a single body of a System
+typedef FixedEulerRBIntegrator<POS_STATE_SIZE, VEL_STATE_SIZE> BodyEulerIntegrator;
+
+class System : public StaticIntegrableSystem<System>
 {
 public:
+	/**
+	 * Takes over the bodies, moving them into the body store. The bodies in
+	 * bVector are deleted and its pointers replaced by the moved bodies,
+	 * which belong to the System and are freed with it. The caller must not
+	 * keep any other pointer to the bodies it passed in.
+	 */
 	System(std::vector<Body*> &bVector);
 	~System(void);
 
+	/**
+	 * Advances the bodies by one step of dt: the collision passes from x and
+	 * v, then the contact passes along the contact graph, then sleeping. The
+	 * number of passes run is left in collision_iterations and
+	 * contact_iterations.
+	 */
+	void step(RBIntegratorType integrator, real_t dt);
+	int collision_iterations;
+	int contact_iterations;
+
 	void zero_forces();
 	void add_gravity();
-	bool collsion_detect(const RBIntegrator* pIntegrator, double dt, double* prev_pos, double* prev_vel);
-	bool contact_detect(const RBIntegrator* pIntegrator, double dt, double* prev_pos, int iter, bool is_shock_prop);
-	virtual void eval_deriv_pos(double xdot[]);
-	virtual void eval_deriv_vel(double xdot[]);
-	virtual void get_state_pos(double x[]) const;
-	virtual void get_state_vel(double x[]) const;
-	virtual void get_state_pos(double x[], int i) const;
-	virtual void get_state_vel(double x[], int i) const;
-	virtual void get_state_pos(double x[], Body *b) const;
-	virtual void get_state_vel(double x[], Body *b) const;
+	bool collsion_detect(RBIntegratorType integrator, real_t dt, real_t* prev_pos, real_t* prev_vel);
+	bool contact_detect(RBIntegratorType integrator, real_t dt, real_t* prev_pos, int iter, bool is_shock_prop);
+	// the per-body calls taking a slot come from StaticIntegrableSystem
+	using StaticIntegrableSystem<System>::get_state_pos;
+	using StaticIntegrableSystem<System>::get_state_vel;
+	using StaticIntegrableSystem<System>::set_state_pos;
+	using StaticIntegrableSystem<System>::set_state_vel;
+	using StaticIntegrableSystem<System>::eval_deriv_pos;
+	using StaticIntegrableSystem<System>::eval_deriv_vel;
+	virtual void eval_deriv_pos(real_t xdot[]);
+	virtual void eval_deriv_vel(real_t xdot[]);
+	virtual void get_state_pos(real_t x[]) const;
+	virtual void get_state_vel(real_t x[]) const;
+	void get_state_pos(real_t x[], const Body *b) const;
+	void get_state_vel(real_t x[], const Body *b) const;
 	virtual void get_bodies(std::vector<Body*> &);
-	virtual void set_state_pos(const double x[]);
-	virtual void set_state_vel(const double x[]);
-	virtual void set_state_pos(const double x[], int i);
-	virtual void set_state_vel(const double x[], int i);
-	virtual void set_state_pos(const double x[], Body *b);
-	virtual void set_state_vel(const double x[], Body *b);
-	virtual void eval_deriv_pos( double xdot[], int i);
-	virtual void eval_deriv_vel( double xdot[], int i);
+	virtual void set_state_pos(const real_t x[]);
+	virtual void set_state_vel(const real_t x[]);
+	void set_state_pos(const real_t x[], Body *b);
+	void set_state_vel(const real_t x[], Body *b);
+
+	// the static system interface, which the integrators call directly
+	void body_get_pos(real_t x[], int i) const { get_state_pos(x, bVector[i]); }
+	void body_get_vel(real_t x[], int i) const { get_state_vel(x, bVector[i]); }
+	void body_set_pos(const real_t x[], int i) { set_state_pos(x, bVector[i]); }
+	void body_set_vel(const real_t x[], int i) { set_state_vel(x, bVector[i]); }
+	void body_deriv_pos(real_t xdot[], int i);
+	void body_deriv_vel(real_t xdot[], int i);
+	bool body_asleep(int i) const { return bVector[i]->asleep; }
+	void create_contact_graph(RBIntegratorType integrator, real_t dt);
+	/**
+	 * Euler steps the velocities or positions of every awake body in one
+	 * pass over structure of arrays buffers. The results are the same as
+	 * stepping each body with BodyEulerIntegrator.
+	 */
+	void batch_integrate_vel(real_t dt);
+	void batch_integrate_pos(real_t dt);
+	/**
+	 * Steps the velocities or positions of every awake body with the
+	 * type of integrator. Euler goes through the batch kernels.
+	 */
+	void integrate_vel(RBIntegratorType integrator, real_t dt);
+	void integrate_pos(RBIntegratorType integrator, real_t dt);
+	/**
+	 * Steps body i the way an integrator of the type would, but with the
+	 * steps of RBSteps.h bound to this system, so the per-body calls inline.
+	 */
+	void integrate_body_vel(RBIntegratorType integrator, real_t dt, int i);
+	void integrate_body_pos(RBIntegratorType integrator, real_t dt, int i);
 	void topological_tarjan();
+	void update_sleep(real_t dt);
+	void wake(Body *b);
 	void saveOutputData(std::vector<BodyInfo> &);
 	virtual unsigned int num_bodies() const;
 	virtual unsigned int size_pos() const;
 	virtual unsigned int size_vel() const;
 
+	// the bodies in the order the passes visit them, which changes every
+	// frame. They live in the store, where Body::id finds them.
 	std::vector<Body*> bVector;
 	int size;
+	BodyStore store;
+
+	void set_broadphase(Broadphase* i_broadphase);
+	void refit_broadphase(real_t dt);
+	void query_bodies(const AABB &box, std::vector<Body*> &bodies);
+	bool test_intersection(Body *b1, Body *b2);
+	bool resolve_collision(Body *b1, Body *b2, const Vec3 &r1, const Vec3 &r2, const Vec3 &normal);
+
+	/**
+	 * Solves the islands of the collision and contact passes on this many
+	 * threads. Islands are only found through the broadphase, so without
+	 * one the passes always run on the calling thread.
+	 */
+	void set_num_threads(int num_threads);
+	int num_threads() const;
+
+	// culls the pairs of moving bodies tested by the collision and contact passes,
+	// NULL tests every pair
+	Broadphase* broadphase;
+	// neighbour lookup for building the contact graph
+	SpatialHash contact_grid;
+	// narrowphase results kept between tests of the same pair
+	PairCache pair_cache;
+	// let islands of resting bodies fall asleep
+	bool sleeping_enabled;
+	// sweep fast pairs through the step in the collision pass
+	bool ccd_enabled;
 
 private:
+	/**
+	 * A group of bodies which can only touch each other and the static bodies
+	 * during a pass. Islands share nothing that the passes write to, so they
+	 * can be solved on different threads.
+	 */
+	struct Island
+	{
+		// slots in bVector of the island's bodies and the static bodies they
+		// may touch, in increasing order
+		std::vector<int> sweep;
+		// candidate pairs of the island as (smaller slot, larger slot), sorted
+		std::vector<std::pair<int, int> > pairs;
+		int num_bodies;
+		bool has_awake;
+		// set by the island's task if it applied an impulse
+		bool found;
+	};
+
+	/**
+	 * Scratch space of a thread running a pass.
+	 */
+	struct PassScratch
+	{
+		std::vector<Body*> neighbours;
+		std::vector<Body*> candidate_bodies;
+		std::vector<std::pair<int, int> > candidate_order;
+	};
+
+	/**
+	 * The arguments of the pass being run by the worker pool.
+	 */
+	struct PassArgs
+	{
+		RBIntegratorType integrator;
+		real_t dt;
+		real_t* prev_pos;
+		real_t* prev_vel;
+		int iter;
+		bool is_shock_prop;
+	};
+
+	bool collide_pair(RBIntegratorType integrator, real_t dt, real_t* prev_pos, real_t* prev_vel, int i, int k);
+	bool contact_sweep(RBIntegratorType integrator, real_t dt, real_t* prev_pos, int iter, bool is_shock_prop,
+	                   const std::vector<int> &sweep, int island, PassScratch &scratch);
+	void query_bodies(const AABB &box, std::vector<Body*> &bodies, PassScratch &scratch, bool with_static = true);
+	void find_candidate_pairs(real_t dt);
+	void build_islands(const std::vector<std::pair<int, int> > &pairs);
+	bool run_islands(RBIntegratorType integrator, WorkerPool::TaskFunc task);
+	static void collide_island_task(void *data, int task, int thread);
+	static void contact_island_task(void *data, int task, int thread);
+	void update_slots();
+	bool narrowphase(Body *b1, Body *b2, ContactSet &contacts);
+	bool needs_sweep(const Body *b1, const Body *b2, const real_t *pos1, const real_t *pos2) const;
+	bool time_of_impact(int i, int k, const real_t *prev_pos, real_t &toi, ContactSet &contacts);
+	void set_sweep_pose(int i, const real_t *prev_pos, real_t t);
+	bool resolve_manifold(Body *b1, Body *b2, const ContactSet &contacts, int iter, bool is_contact);
 	bool resolve_collisions(Body *b1, Body *b2, Vec3 r1, Vec3 r2, Vec3 normal, int iter, bool is_contact);
+	real_t pair_restitution(const Body *b1, const Body *b2, int iter, bool is_contact) const;
+	void apply_impulse(Body *b1, Body *b2, const Vec3 &r1, const Vec3 &r2, const Vec3 &j);
 	void strongconnect(Body* b, int &index);
+	bool pair_is_active(const Body *b1, const Body *b2) const;
+	int find_island(int i);
+
+	// position of each body in bVector, indexed by Body::id
+	std::vector<int> slot_of;
+	// Static bodies never move, so they are kept out of the broadphase in a
+	// tree which is built once. Only the moving bodies query it, so pairs of
+	// static bodies are never found.
+	std::vector<Body*> moving_bodies;
+	AABBTree static_tree;
+	// planes reach every body, so they are paired with all the moving bodies
+	// instead of being put in a tree
+	std::vector<Body*> planes;
+	std::vector<BodyPair> broadphase_pairs;
+	std::vector<std::pair<int, int> > candidate_pairs;
+	PassScratch main_scratch;
+	// every slot in order, the sweep of a pass run on a single thread
+	std::vector<int> all_slots;
+
+	// union-find over the slots of bVector used to group the contact graph into islands
+	std::vector<int> island_parent;
+	std::vector<int> island_label;
+	std::vector<bool> island_ready;
+	int next_island;
+
+	// islands of the current pass, only the first num_islands are in use
+	std::vector<Island> islands;
+	int num_islands;
+	// island of each slot, -1 for static bodies
+	std::vector<int> island_of;
+	// islands with work to do, biggest first
+	std::vector<int> island_tasks;
+
+	WorkerPool *workers;
+	std::vector<PassScratch> thread_scratch;
+	PassArgs pass;
+	// true while islands are being solved on the worker pool
+	bool in_parallel_pass;
+
+	// x' and v' of every slot, kept by the collision pass while it rolls
+	// bodies back to apply impulses
+	std::vector<real_t> curr_pos;
+	std::vector<real_t> curr_vel;
+	// the state of every slot while the contact graph moves bodies one at a time
+	std::vector<real_t> graph_pos;
+	std::vector<real_t> graph_vel;
+	// x and v of every slot at the start of a step
+	std::vector<real_t> step_pos;
+	std::vector<real_t> step_vel;
+	// the moving bodies the contact grid is built over
+	std::vector<Body*> grid_bodies;
+
+	// Tarjan's algorithm: the bodies in topological order, the stack of the
+	// search and the number of strongly connected components found so far.
+	// The vectors are cleared, not freed, between frames.
+	std::vector<Body*> top_sorted;
+	std::vector<Body*> tarjan_stack;
+	int num_SCCs;
+
+	// slots of the awake bodies stepped by batch_integrate_vel/pos, the
+	// batch holds BATCH_CHUNK of them at a time
+	BodyBatch batch;
+	std::vector<int> batch_slots;
+	void collect_batch_slots();
 };
@@ -0,0 +1,39 @@
+/**
+ * @file Timestep.cpp
+ * @brief Turns wall clock time into a whole number of fixed simulation steps.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "Timestep.h"
+
+FixedTimestep::FixedTimestep(double i_dt, int i_max_substeps) : dt(i_dt), max_substeps(i_max_substeps),
+                                                               dropped(0.0), accumulator(0.0)
+{
+}
+
+int FixedTimestep::advance(double elapsed)
+{
+    // the clock can jump back when it wraps or is reset
+    if(elapsed > 0.0)
+        accumulator += elapsed;
+
+    int steps = (int) (accumulator / dt);
+    if(steps > max_substeps){
+        // keep the fraction of a step so the drawing does not jump
+        double excess = (steps - max_substeps)*dt;
+        accumulator -= excess;
+        dropped += excess;
+        steps = max_substeps;
+    }
+    accumulator -= steps*dt;
+    if(accumulator < 0.0)
+        accumulator = 0.0;
+    return steps;
+}
+
+void FixedTimestep::reset()
+{
+    accumulator = 0.0;
+    dropped = 0.0;
+}
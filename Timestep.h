@@ -0,0 +1,46 @@
+/**
+ * @file Timestep.h
+ * @brief Turns wall clock time into a whole number of fixed simulation steps.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+/**
+ * Runs the simulation at a fixed step however often it is ticked.
+ *
+ * Each tick adds the wall clock time since the last one to an accumulator,
+ * and every whole dt in it is a step to run. A late tick is made up with
+ * extra steps, up to max_substeps a tick. Time beyond that is dropped, so a
+ * long stall slows the simulation down for a moment instead of making every
+ * following tick slower still. What is left in the accumulator is part of a
+ * step, and alpha() says how far to draw the bodies between their last two
+ * states.
+ */
+class FixedTimestep
+{
+public:
+    FixedTimestep(double dt, int max_substeps);
+
+    /**
+     * Adds elapsed seconds of wall clock time and returns the number of
+     * steps to run now.
+     */
+    int advance(double elapsed);
+
+    /**
+     * How far the wall clock is from the last step to the next, in [0, 1).
+     */
+    double alpha() const { return accumulator / dt; }
+
+    void reset();
+
+    const double dt;
+    const int max_substeps;
+    // wall clock seconds thrown away by the substep cap since the last reset
+    double dropped;
+
+private:
+    double accumulator;
+};
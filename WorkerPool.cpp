@@ -0,0 +1,123 @@
+/**
+ * @file WorkerPool.cpp
+ * @brief A fixed set of threads which share out the tasks of a parallel loop.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "WorkerPool.h"
+
+struct WorkerArgs
+{
+    WorkerPool *pool;
+    int thread;
+};
+
+WorkerPool::WorkerPool(int num_threads) : func(NULL), data(NULL), num_tasks(0), next_task(0),
+                                          busy_workers(0), generation(0), quit(false)
+{
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&start_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+
+    for(int i = 1; i < num_threads; ++i){
+        WorkerArgs *args = new WorkerArgs;
+        args->pool = this;
+        args->thread = i;
+        pthread_t tid;
+        if(pthread_create(&tid, NULL, worker_main, args) != 0){
+            // carry on with the threads we have
+            delete args;
+            break;
+        }
+        threads.push_back(tid);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&lock);
+
+    for(int i = 0; i < threads.size(); ++i){
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&done_cond);
+    pthread_cond_destroy(&start_cond);
+    pthread_mutex_destroy(&lock);
+}
+
+void WorkerPool::run(TaskFunc i_func, void *i_data, int i_num_tasks)
+{
+    if(threads.empty() || i_num_tasks <= 1)
+    {
+        for(int task = 0; task < i_num_tasks; ++task)
+            i_func(i_data, task, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    func = i_func;
+    data = i_data;
+    num_tasks = i_num_tasks;
+    next_task = 0;
+    busy_workers = threads.size();
+    generation++;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&lock);
+
+    work(0);
+
+    // the loop is only over once every worker has stopped looking at it
+    pthread_mutex_lock(&lock);
+    while(busy_workers > 0)
+        pthread_cond_wait(&done_cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Takes tasks of the current loop until there are none left.
+ **/
+void WorkerPool::work(int thread)
+{
+    while(true){
+        pthread_mutex_lock(&lock);
+        int task = next_task < num_tasks ? next_task++ : -1;
+        pthread_mutex_unlock(&lock);
+
+        if(task < 0)
+            return;
+        func(data, task, thread);
+    }
+}
+
+void *WorkerPool::worker_main(void *ptr)
+{
+    WorkerArgs *args = (WorkerArgs *) ptr;
+    WorkerPool *pool = args->pool;
+    int thread = args->thread;
+    delete args;
+
+    int seen_generation = 0;
+    while(true){
+        pthread_mutex_lock(&pool->lock);
+        while(!pool->quit && pool->generation == seen_generation)
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        if(pool->quit){
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->work(thread);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->busy_workers == 0)
+            pthread_cond_signal(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * @file WorkerPool.h
+ * @brief A fixed set of threads which share out the tasks of a parallel loop.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <vector>
+#include <pthread.h>
+
+/**
+ * Runs the tasks of a parallel loop on a fixed set of threads.
+ *
+ * The threads are started once and sleep between loops. The thread which
+ * calls run() takes tasks as well, so a pool of n threads starts n - 1
+ * workers. Tasks are handed out one at a time in order, so putting the
+ * biggest tasks first keeps the threads busy until the end of the loop.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * Called for each task. thread is in [0, num_threads()) and no two
+     * tasks running at the same time get the same thread.
+     */
+    typedef void (*TaskFunc)(void *data, int task, int thread);
+
+    WorkerPool(int num_threads);
+    ~WorkerPool();
+
+    /**
+     * Calls func(data, task, thread) for every task in [0, num_tasks)
+     * and returns once all of them have finished.
+     */
+    void run(TaskFunc func, void *data, int num_tasks);
+
+    int num_threads() const { return threads.size() + 1; }
+
+private:
+    static void *worker_main(void *ptr);
+    void work(int thread);
+
+    std::vector<pthread_t> threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+
+    // the current loop, guarded by lock
+    TaskFunc func;
+    void *data;
+    int num_tasks;
+    int next_task;
+    int busy_workers;
+    // bumped for every loop so the workers can tell a new one has started
+    int generation;
+    bool quit;
+};
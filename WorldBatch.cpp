@@ -0,0 +1,107 @@
+/**
+ * @file WorldBatch.cpp
+ * @brief Many independent simulations stepped together on a thread pool.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#include "WorldBatch.h"
+#include <stdlib.h>
+#include <algorithm>
+
+WorldBatch::WorldBatch(int num_worlds, SceneFunc scene, void *data, RBIntegratorType integrator) :
+    workers(NULL), pass_dt(0.0), pass_steps(0)
+{
+    worlds.resize(num_worlds);
+    first_bodies.push_back(0);
+    for(int i = 0; i < num_worlds; ++i){
+        World &w = worlds[i];
+        std::vector<Body*> bodies;
+        scene(bodies, i, data);
+        w.sys = new System(bodies);
+        w.integrator = integrator;
+        w.seed = i + 1;
+        first_bodies.push_back(first_bodies.back() + w.sys->num_bodies());
+    }
+    pos.resize(num_bodies()*RB_POS_SIZE);
+    vel.resize(num_bodies()*RB_VEL_SIZE);
+    for(int i = 0; i < num_worlds; ++i)
+        gather(i);
+}
+
+WorldBatch::~WorldBatch()
+{
+    for(int i = 0; i < worlds.size(); ++i){
+        delete worlds[i].sys;
+    }
+    delete workers;
+}
+
+void WorldBatch::set_num_threads(int num_threads)
+{
+    delete workers;
+    workers = num_threads > 1 ? new WorkerPool(num_threads) : NULL;
+}
+
+int WorldBatch::num_threads() const
+{
+    return workers ? workers->num_threads() : 1;
+}
+
+void WorldBatch::step(real_t dt, int num_steps)
+{
+    pass_dt = dt;
+    pass_steps = num_steps;
+    if(workers){
+        workers->run(step_task, this, worlds.size());
+        return;
+    }
+    for(int i = 0; i < worlds.size(); ++i)
+        step_task(this, i, 0);
+}
+
+/**
+ * Runs the steps of one world and copies out its state.
+ **/
+void WorldBatch::step_task(void *data, int task, int thread)
+{
+    WorldBatch *batch = (WorldBatch *) data;
+    for(int s = 0; s < batch->pass_steps; ++s)
+        batch->step_world(batch->worlds[task], batch->pass_dt);
+    batch->gather(task);
+}
+
+/**
+ * One step of the world, the same as step_simulation in LocalRigidBodies but
+ * shuffled with the world's own random seed.
+ **/
+void WorldBatch::step_world(World &w, real_t dt)
+{
+    System *sys = w.sys;
+    int n = sys->num_bodies();
+
+    // randomly shuffle the moving bodies to eliminate bias
+    for(int ii = 0; ii < 15; ii++)
+    {
+        int jj = rand_r(&w.seed) % n;
+        int kk = rand_r(&w.seed) % n;
+        if(sys->bVector[jj]->inv_mass > 0 && sys->bVector[kk]->inv_mass > 0)
+            std::swap(sys->bVector[jj], sys->bVector[kk]);
+    }
+
+    sys->step(w.integrator, dt);
+}
+
+/**
+ * Copies the states of the bodies of world i into the state arrays.
+ **/
+void WorldBatch::gather(int i)
+{
+    System *sys = worlds[i].sys;
+    real_t *x = &pos[0] + first_bodies[i]*RB_POS_SIZE;
+    real_t *v = &vel[0] + first_bodies[i]*RB_VEL_SIZE;
+    for(int id = 0; id < sys->store.size(); ++id){
+        sys->get_state_pos(x + id*RB_POS_SIZE, sys->store[id]);
+        sys->get_state_vel(v + id*RB_VEL_SIZE, sys->store[id]);
+    }
+}
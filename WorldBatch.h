@@ -0,0 +1,94 @@
+/**
+ * @file WorldBatch.h
+ * @brief Many independent simulations stepped together on a thread pool.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include <vector>
+#include "System.h"
+#include "integrator.h"
+#include "WorkerPool.h"
+
+/**
+ * Owns a number of independent worlds, each a System with its own bodies,
+ * and steps them all at once with the worlds shared out over a pool of
+ * threads. Nothing is drawn, so a batch can run a sweep over the parameters
+ * of a scene from a single headless process.
+ *
+ * Each step of a world is the frame of LocalRigidBodies: the collision pass,
+ * the contact graph, the contact and shock propagation passes and the sleep
+ * test. The shuffle of the bodies before each step is seeded per world, so
+ * a world ends up in the same state whatever the number of threads.
+ *
+ * After every call to step() the states of all the bodies are copied into
+ * two contiguous arrays, world after world and by Body::id within a world.
+ */
+class WorldBatch
+{
+public:
+    /**
+     * Builds the bodies of world number world into bodies. Called once for
+     * each world from the constructor, on the calling thread.
+     */
+    typedef void (*SceneFunc)(std::vector<Body*> &bodies, int world, void *data);
+
+    WorldBatch(int num_worlds, SceneFunc scene, void *data, RBIntegratorType integrator = RB_EULER);
+    ~WorldBatch();
+
+    /**
+     * Steps the worlds on this many threads, the calling one included.
+     */
+    void set_num_threads(int num_threads);
+    int num_threads() const;
+
+    /**
+     * Runs num_steps steps of dt in every world and gathers their states.
+     */
+    void step(real_t dt, int num_steps = 1);
+
+    int num_worlds() const { return worlds.size(); }
+    System& world(int i) { return *worlds[i].sys; }
+
+    /**
+     * The number of bodies in all the worlds, and the index of the first
+     * body of world i in the state arrays.
+     */
+    int num_bodies() const { return first_bodies.back(); }
+    int first_body(int i) const { return first_bodies[i]; }
+
+    /**
+     * The position states, RB_POS_SIZE reals a body, and the velocity
+     * states, RB_VEL_SIZE reals a body, of every body as of the last step.
+     */
+    const real_t* pos_states() const { return &pos[0]; }
+    const real_t* vel_states() const { return &vel[0]; }
+
+private:
+    WorldBatch(const WorldBatch&);
+    WorldBatch& operator=(const WorldBatch&);
+
+    struct World
+    {
+        System *sys;
+        RBIntegratorType integrator;
+        unsigned int seed;
+    };
+
+    static void step_task(void *data, int task, int thread);
+    void step_world(World &w, real_t dt);
+    void gather(int i);
+
+    std::vector<World> worlds;
+    // first_bodies[i] is the first body of world i, the last entry the total
+    std::vector<int> first_bodies;
+    std::vector<real_t> pos;
+    std::vector<real_t> vel;
+    WorkerPool *workers;
+
+    // the arguments of the steps being run on the pool
+    real_t pass_dt;
+    int pass_steps;
+};
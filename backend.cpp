@@ -6,7 +6,10 @@
 #include "System.h"
 #include "integrator.h"
 #include "Box.h"
+#include "Plane.h"
+#include "ShapeRegistry.h"
 #include "csapp.h"
+#include "Timestep.h"
 #include "fps.h"
 
 #include <vector>
@@ -16,9 +19,6 @@
 #include <time.h>
 
 /* macros */
-#define MAX_COLLISIONS 5
-#define MAX_CONTACTS 10
-#define MAX_SHOCK_PROP 100
 #define rot_ang PI/6.0
 
 /* global variables */
@@ -42,9 +42,16 @@ static int hmx, hmy;
 // flag for whether the mouse has already been registered as being down
 static bool clicked;
 
-static RBIntegrator* integrator;
+static RBIntegratorType integrator_type = RB_EULER;
 static System* sys = NULL;
 
+// runs the steps at dt whatever the timer does
+#define MAX_SUBSTEPS 4
+static FixedTimestep *timestep;
+static int prev_tick_time;
+// pose of each body before the last step, indexed by Body::id
+static std::vector<BodyInfo> last_pose;
+
 // camera data
 Vec3 camera(0.0, 10.0, -20.0);
 Vec3 target(0.0, 0.0, 0.0);
@@ -63,7 +70,7 @@ static void free_data ( void )
     bodyInfoList.clear();
     delete sys;
     bVector.clear();
-    delete integrator;
+    delete timestep;
 }
 
 static void clear_data ( void )
@@ -86,9 +93,9 @@ static void init_slide()
     const Vec3 z_offset(0.0, 0.0, dist);
 
     // floor
-    bVector.push_back(new Body(center, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), new Box(Color3(1.0, 1.0, .5)), Vec3(20, 20, 20), 1.0, .7, 0.0));
+    bVector.push_back(new Body(center, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), ShapeRegistry::get(SHAPE_BOX), Color3(1.0, 1.0, .5), Vec3(20, 20, 20), 1.0, .7, 0.0));
     
-    bVector.push_back(new Body(center + (10*(sin(rot_ang) + cos(rot_ang)) + .5*(cos(rot_ang) - sin(rot_ang)) + 10000000*EPSILON)*y_offset + (10*(cos(rot_ang) - sin(rot_ang)) - .5*(sin(rot_ang) + cos(rot_ang)) + 10000000*EPSILON)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 1.0, 1.0));
+    bVector.push_back(new Body(center + (10*(sin(rot_ang) + cos(rot_ang)) + .5*(cos(rot_ang) - sin(rot_ang)) + 10000000*EPSILON)*y_offset + (10*(cos(rot_ang) - sin(rot_ang)) - .5*(sin(rot_ang) + cos(rot_ang)) + 10000000*EPSILON)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), rot_ang), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 1.0, 1.0));
 }
 
 static void init_combo()
@@ -100,29 +107,29 @@ static void init_combo()
     const Vec3 z_offset(0.0, 0.0, dist);
 
     // floor
-    bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset + (3 - 4.75/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.7, 0.0, .0)), Vec3(10, .5, 10), .4, .5, 0.0));
-    bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset - (10 + 3.25/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), -PI/4.0), new Box(Color3(0.0, 0.2, .7)), Vec3(10, .5, 10), .4, .5, 0.0));
-    bVector.push_back(new Body(center - 60*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 100, 100), .4, 0.5, 0.0));
+    bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset + (3 - 4.75/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.7, 0.0, .0), Vec3(10, .5, 10), .4, .5, 0.0));
+    bVector.push_back(new Body(center - (3 + 5.0*sqrt(2) - 14.75/sqrt(2))*y_offset - (10 + 3.25/sqrt(2))*x_offset,  Quaternion(Vec3(0.0, 0.0, 1.0), -PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(0.0, 0.2, .7), Vec3(10, .5, 10), .4, .5, 0.0));
+    bVector.push_back(new Body(center - 10*y_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), .4, 0.5, 0.0));
     // right
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .7)*y_offset - (.5*sqrt(2) - 1.7)*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1.7, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (.5*sqrt(2) - 1.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (.5*sqrt(2) - 2)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7 + 3.5)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1.7, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .7)*y_offset - (.5*sqrt(2) - 1.7)*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1.7, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (.5*sqrt(2) - 1.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (.5*sqrt(2) - 2)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.7 + 3.5)*y_offset - (.5*sqrt(2) - 2.7)*x_offset - 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1.7, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2 + 3.5)*y_offset - (.5*sqrt(2) - 3)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
     //left
-	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) + 10)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1.7, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (3.5*sqrt(2) - 4.5 + 13)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) - 3 + 13)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5 + 3.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8 + 3.5)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1.7, 1), .7, .5, 1.0));
-    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1 + 3.5)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(1, .7, .1)), Vec3(1, 1, 1.5), .7, .5, 1.0));
+	bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) + 10)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1.7, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .5)*y_offset - (3.5*sqrt(2) - 4.5 + 13)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 2)*y_offset - (3.5*sqrt(2) - 3 + 13)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1.5 + 3.5)*y_offset - (3.5*sqrt(2) + 9.5)*x_offset - 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + .8 + 3.5)*y_offset - (3.5*sqrt(2) - 4.7 + 13.5)*x_offset + 2*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1.7, 1), .7, .5, 1.0));
+    bVector.push_back(new Body(center + (5*(sqrt(2) - 1) + 1 + 3.5)*y_offset - (3.5*sqrt(2) - 5 + 14)*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(1, .7, .1), Vec3(1, 1, 1.5), .7, .5, 1.0));
 }
 
 static void init_single_box()
@@ -134,9 +141,9 @@ static void init_single_box()
     const Vec3 z_offset(0.0, 0.0, dist);
 
     // floor
-    bVector.push_back(new Body(center - 5*x_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(10, 10, 10), 0.5, 0.5, 0));
+    bVector.push_back(new Body(center - 5*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1.0, 1.0, .5), Vec3(10, 10, 10), 0.5, 0.5, 0));
 
-    bVector.push_back(new Body(center + 4*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
+    bVector.push_back(new Body(center + 4*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
 }
 
 static void init_small_pile()
@@ -148,16 +155,16 @@ static void init_small_pile()
     const Vec3 z_offset(0.0, 0.0, dist);
 
     // floor
-    bVector.push_back(new Body(center - 50*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 100, 100), .6, 0.5, 0));
-
-    bVector.push_back(new Body(center + 3*y_offset - 4*x_offset + 0.5*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-    bVector.push_back(new Body(center + 5.5*y_offset - 2.2*x_offset + z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-    bVector.push_back(new Body(center + 3*y_offset - x_offset + 0.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
-    bVector.push_back(new Body(center + 1.7*y_offset - 1.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
-    bVector.push_back(new Body(center + 2*y_offset - 5*x_offset + 2.5*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-    bVector.push_back(new Body(center + 6.5*y_offset - 3.2*x_offset - z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-    bVector.push_back(new Body(center + 3*y_offset - 2*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
-    bVector.push_back(new Body(center + 4.7*y_offset - 3.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
+    bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), .6, 0.5, 0));
+
+    bVector.push_back(new Body(center + 3*y_offset - 4*x_offset + 0.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+    bVector.push_back(new Body(center + 5.5*y_offset - 2.2*x_offset + z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+    bVector.push_back(new Body(center + 3*y_offset - x_offset + 0.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
+    bVector.push_back(new Body(center + 1.7*y_offset - 1.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
+    bVector.push_back(new Body(center + 2*y_offset - 5*x_offset + 2.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+    bVector.push_back(new Body(center + 6.5*y_offset - 3.2*x_offset - z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+    bVector.push_back(new Body(center + 3*y_offset - 2*x_offset + 1.5*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
+    bVector.push_back(new Body(center + 4.7*y_offset - 3.5*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
 }
 
 static void init_high_pile()
@@ -169,20 +176,20 @@ static void init_high_pile()
     const Vec3 z_offset(0.0, 0.0, dist);
 
     // floor
-    bVector.push_back(new Body(center - 500*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(1000, 1000, 1000), .6, 0.5, 0));
+    bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(1000, 0, 1000), .6, 0.5, 0));
 	
 	int iter=3; // 217 total objects
     for(int i = 0; i < iter; i++){
         for(int k = 0; k < iter; k++){
             for(int z = 0; z < iter; z++){
-                bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (4 + (k-2)*7.5)*x_offset + (0.5 + (z-2)*15)*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-                bVector.push_back(new Body(center + (5+18*iter + (i-2)*18)*y_offset - (1.2 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-                bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (k-2)*7.5*x_offset + (0.5 + (z-2)*15)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
-                bVector.push_back(new Body(center + (1.7+18*iter + (i-2)*18)*y_offset - (1.5 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
-                bVector.push_back(new Body(center + (2+18*iter + (i-2)*18)*y_offset - (5 + (k-2)*7.5)*x_offset + (2.5 + (z-2)*15)*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-                bVector.push_back(new Body(center + (6.5+18*iter + (i-2)*18)*y_offset - (3.2 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
-                bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (2 + (k-2)*7.5)*x_offset + (1.5 + (z-2)*15)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
-                bVector.push_back(new Body(center + (4.7+18*iter + (i-2)*18)*y_offset - (3.5 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), new Box(Color3(.1, .7, .1)), Vec3(1, 1, 1), 1.0, 0.5, 1));
+                bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (4 + (k-2)*7.5)*x_offset + (0.5 + (z-2)*15)*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+                bVector.push_back(new Body(center + (5+18*iter + (i-2)*18)*y_offset - (1.2 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+                bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (k-2)*7.5*x_offset + (0.5 + (z-2)*15)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
+                bVector.push_back(new Body(center + (1.7+18*iter + (i-2)*18)*y_offset - (1.5 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1.f));
+                bVector.push_back(new Body(center + (2+18*iter + (i-2)*18)*y_offset - (5 + (k-2)*7.5)*x_offset + (2.5 + (z-2)*15)*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+                bVector.push_back(new Body(center + (6.5+18*iter + (i-2)*18)*y_offset - (3.2 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 1), 1.0, 0.5, 0.5));
+                bVector.push_back(new Body(center + (3+18*iter + (i-2)*18)*y_offset - (2 + (k-2)*7.5)*x_offset + (1.5 + (z-2)*15)*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/8.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
+                bVector.push_back(new Body(center + (4.7+18*iter + (i-2)*18)*y_offset - (3.5 + (k-2)*7.5)*x_offset + (z-2)*15*z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/4.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 1, 1), 1.0, 0.5, 1));
             }
         }
     }
@@ -197,17 +204,17 @@ static void init_big_pile()
     const Vec3 z_offset(0.0, 0.0,dist);
 
     // floor
-    bVector.push_back(new Body(center - 50*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 100, 100), .3, 0.5, 0));
-
-    bVector.push_back(new Body(center + 5*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), new Box(Color3(.1, .8, .7)), Vec3(1, 1, 1), .7, 0.5, 1));
-    bVector.push_back(new Body(center + 4.5*y_offset + 2*x_offset - z_offset, Quaternion::Identity, new Box(Color3(.7, .0, .4)), Vec3(1, 1, 1), .7, 0.5, 1));
-    bVector.push_back(new Body(center + 4.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, new Box(Color3(1., .4, .1)), Vec3(1, 1, 1), .7, 0.5, 1));
-    bVector.push_back(new Body(center + 8*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), new Box(Color3(.0, .4, .2)), Vec3(1, 1, 1), .7, 0.5, 1));
-    bVector.push_back(new Body(center + 7*y_offset + 2*x_offset - z_offset, Quaternion(Vec3(0.0, 1.0, 1.0), PI/6.0), new Box(Color3(.0, .1, .7)), Vec3(1, 1, 1), .7, 0.5, 1));
-    bVector.push_back(new Body(center + 7.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, new Box(Color3(.3, .3, .3)), Vec3(1, 1, 1), .7, 0.5, 1));
-    bVector.push_back(new Body(center + 3.5*y_offset + 1*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 1, 3), .7, 0.5, 1./6.));
-    bVector.push_back(new Body(center + 1.5*y_offset + 2*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 2, 2), .7, 0.5, .125));
-    bVector.push_back(new Body(center + 6*y_offset + 3*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/2.5), new Box(Color3(.1, .7, .1)), Vec3(1, 2, 2), .7, 0.5, .25));
+    bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), .3, 0.5, 0));
+
+    bVector.push_back(new Body(center + 5*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .8, .7), Vec3(1, 1, 1), .7, 0.5, 1));
+    bVector.push_back(new Body(center + 4.5*y_offset + 2*x_offset - z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.7, .0, .4), Vec3(1, 1, 1), .7, 0.5, 1));
+    bVector.push_back(new Body(center + 4.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1., .4, .1), Vec3(1, 1, 1), .7, 0.5, 1));
+    bVector.push_back(new Body(center + 8*y_offset + 2.5*x_offset + z_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/6.0), ShapeRegistry::get(SHAPE_BOX), Color3(.0, .4, .2), Vec3(1, 1, 1), .7, 0.5, 1));
+    bVector.push_back(new Body(center + 7*y_offset + 2*x_offset - z_offset, Quaternion(Vec3(0.0, 1.0, 1.0), PI/6.0), ShapeRegistry::get(SHAPE_BOX), Color3(.0, .1, .7), Vec3(1, 1, 1), .7, 0.5, 1));
+    bVector.push_back(new Body(center + 7.5*y_offset + 3.3*x_offset - .5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.3, .3, .3), Vec3(1, 1, 1), .7, 0.5, 1));
+    bVector.push_back(new Body(center + 3.5*y_offset + 1*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 1, 3), .7, 0.5, 1./6.));
+    bVector.push_back(new Body(center + 1.5*y_offset + 2*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 2, 2), .7, 0.5, .125));
+    bVector.push_back(new Body(center + 6*y_offset + 3*x_offset, Quaternion(Vec3(0.0, 0.0, 1.0), PI/2.5), ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(1, 2, 2), .7, 0.5, .25));
 }
 
 static void init_stack()
@@ -219,16 +226,29 @@ static void init_stack()
     const Vec3 z_offset(0.0, 0.0,dist);
 
     // floor
-    bVector.push_back(new Body(center - 50*y_offset, Quaternion::Identity, new Box(Color3(1.0, 1.0, .5)), Vec3(100, 100, 100), .3, 0.5, 0));
-
-    bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset + 2.5*z_offset, Quaternion::Identity, new Box(Color3(.1, .8, .7)), Vec3(1, 1, 1), .4, 0.5, 1));
-    bVector.push_back(new Body(center + 10.7*y_offset + 2*x_offset + 1.0*z_offset, Quaternion::Identity, new Box(Color3(.7, .0, .4)), Vec3(1, 1, 1), .4, 0.5, 1));
-    bVector.push_back(new Body(center + 9.5*y_offset + 2.3*x_offset + 1.0*z_offset, Quaternion::Identity, new Box(Color3(1., .4, .1)), Vec3(1, 1, 1), .4, 0.5, 1));
-	bVector.push_back(new Body(center + 9.5*y_offset + 1.2*x_offset + 1.0*z_offset, Quaternion::Identity, new Box(Color3(.6, .4, .4)), Vec3(1, 1, 1), .4, 0.5, 1));
-    bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset - z_offset, Quaternion::Identity, new Box(Color3(.0, .4, .2)), Vec3(1.5, 1.5, 1.5), .7, 0.5, 1.0/3.375));
-    bVector.push_back(new Body(center + 50*y_offset + 2*x_offset - 4.5*z_offset, Quaternion::Identity, new Box(Color3(.3, .3, .3)), Vec3(2, 2, 2), .7, 0.5, .125));
-    bVector.push_back(new Body(center + 8.5*y_offset + 2*x_offset - 1*z_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(4, .3, 10), .4, 0.5, 1./6.));
-    bVector.push_back(new Body(center + 4.1*y_offset + 2*x_offset, Quaternion::Identity, new Box(Color3(.1, .7, .1)), Vec3(2, 8, 2), .4, 0.5, 1.0/32.0));
+    bVector.push_back(new Body(center, Quaternion::Identity, ShapeRegistry::get(SHAPE_PLANE), Color3(1.0, 1.0, .5), Vec3(100, 0, 100), .3, 0.5, 0));
+
+    bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset + 2.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .8, .7), Vec3(1, 1, 1), .4, 0.5, 1));
+    bVector.push_back(new Body(center + 10.7*y_offset + 2*x_offset + 1.0*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.7, .0, .4), Vec3(1, 1, 1), .4, 0.5, 1));
+    bVector.push_back(new Body(center + 9.5*y_offset + 2.3*x_offset + 1.0*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(1., .4, .1), Vec3(1, 1, 1), .4, 0.5, 1));
+	bVector.push_back(new Body(center + 9.5*y_offset + 1.2*x_offset + 1.0*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.6, .4, .4), Vec3(1, 1, 1), .4, 0.5, 1));
+    bVector.push_back(new Body(center + 9.5*y_offset + 2.5*x_offset - z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.0, .4, .2), Vec3(1.5, 1.5, 1.5), .7, 0.5, 1.0/3.375));
+    bVector.push_back(new Body(center + 50*y_offset + 2*x_offset - 4.5*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.3, .3, .3), Vec3(2, 2, 2), .7, 0.5, .125));
+    bVector.push_back(new Body(center + 8.5*y_offset + 2*x_offset - 1*z_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(4, .3, 10), .4, 0.5, 1./6.));
+    bVector.push_back(new Body(center + 4.1*y_offset + 2*x_offset, Quaternion::Identity, ShapeRegistry::get(SHAPE_BOX), Color3(.1, .7, .1), Vec3(2, 8, 2), .4, 0.5, 1.0/32.0));
+}
+
+/**
+ * Remembers where the bodies are, so the clients can be sent a pose between
+ * this one and the one after the next step.
+ **/
+static void save_last_pose()
+{
+    for(int i = 0; i < sys->num_bodies(); ++i){
+        Body *b = bVector[i];
+        last_pose[b->id].Pos = b->Position;
+        last_pose[b->id].Orientation = b->Orientation;
+    }
 }
 
 static void init_system( void )
@@ -247,6 +267,8 @@ static void init_system( void )
         BodyInfo *b = new BodyInfo();
         bodyInfoList.push_back(*b);
     }
+    last_pose.resize(sys->num_bodies());
+    save_last_pose();
 }
 
 /*
@@ -305,6 +327,16 @@ static void remap_GUI()
     {
       bVector[ii]->reset();
     }
+    save_last_pose();
+}
+
+/**
+ * Switches the frames to a new kind of integrator.
+ **/
+static void select_integrator(RBIntegratorType type)
+{
+    integrator_type = type;
+    printf("integrator: %s\n", rb_integrator_name(type));
 }
 
 /*
@@ -320,6 +352,10 @@ static void key_func ( unsigned char key, int x, int y )
 	case ' ':
 		remap_GUI();
 		break;
+
+	case 'i':
+		select_integrator((RBIntegratorType) ((integrator_type + 1) % NUM_RB_INTEGRATOR_TYPES));
+		break;
 	
 	case 'Q':
 	case 'q':
@@ -398,134 +434,24 @@ static void reshape_func ( int width, int height )
 }
 
 /**
- * Build a contact graph in the system based on the current state.
+ * Advances the simulation by one step of dt.
  **/
-void create_contact_graph(double *prev_pos, double *prev_vel, bool is_initial){
-    // clear contact graph
-    for(int i = 0; i < sys->num_bodies(); ++i){
-        bVector[i]->in_contact_list.clear();
-    }
-
-    Vec3 p, normal;
-    ContactInfo c;
-    // create contact graph
-    for(int i = 0; i < sys->num_bodies(); ++i){
-        // hack to make sure static objects are never considered resting on anything
-        if(bVector[i]->inv_mass != 0){
-            // evolve each object keeping the others stationary and test for intersection
-            sys->get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-            sys->get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-
-			if(is_initial) // if this is the first time then use gravity
-				integrator->integrate_vel(*sys, dt, i);
-            integrator->integrate_pos(*sys, dt, i);
-
-            for(int k = 0; k < sys->num_bodies(); ++k){
-                // add the contact to the bodies list if there is one
-                if(k != i && bVector[k]->intersection_test(bVector[i], p, normal)){
-                    c.b = bVector[k];
-                    c.p = p;
-                    c.normal = normal;
-                    bVector[i]->in_contact_list.push_back(c);
-                }
-            }
-            sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-            sys->set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-        }
-    }
-
-    // sort bodies based on the new contact graph
-    sys->topological_tarjan();
-    // update the local copy
-    sys->get_bodies(bVector);
+static void step_simulation()
+{
+    sys->step(integrator_type, dt);
 }
 
 static void idle_func ( int value )
 { 
-	// cap the fps
+	// tick again, each tick runs as many fixed steps as the wall clock has moved on by
 	glutTimerFunc (frame_time, idle_func, 0 );
-	
-    double prev_pos[sys->size_pos()];
-    double prev_vel[sys->size_vel()];
-
-    /***********************/
-    /* collision detection */
-	/***********************/
-
-	// get x and v
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		sys->get_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-		sys->get_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-	}
-	
-	// set system to x' and v'
-	sys->zero_forces();
-	sys->add_gravity();
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		integrator->integrate_vel(*sys, dt, i);
-		integrator->integrate_pos(*sys, dt, i);
-	}
-	
-	// find and resolve collisions
-	int count = 0;
-	while(sys->collsion_detect(prev_pos, prev_vel) && count < MAX_COLLISIONS){
-		count++;
-		// set the system back to x and v where v has collision info
-		for(int i = 0; i < sys->num_bodies(); ++i){
-			sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-			sys->set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-		}
-		// get new x' and v'
-		sys->zero_forces();
-		sys->add_gravity();
-		for(int i = 0; i < sys->num_bodies(); ++i){
-			integrator->integrate_vel(*sys, dt, i);
-			integrator->integrate_pos(*sys, dt, i);
-		}
-	}
-	
-	// set the system back to x and v where v has final collision info
-	for(int i = 0; i < sys->num_bodies(); ++i){
-		sys->set_state_pos(prev_pos + i*POS_STATE_SIZE, i);
-		sys->set_state_vel(prev_vel + i*VEL_STATE_SIZE, i);
-	}
-
-	// update forces
-	sys->zero_forces();
-	sys->add_gravity();
-
-    /*********************/
-    /* contact detection */
-    /*********************/
-
-	// create the initial contact graph
-	create_contact_graph(prev_pos, prev_vel, true);
-
-    // integrate velocity
-    for(int i = 0; i < sys->num_bodies(); ++i){
-        integrator->integrate_vel(*sys, dt, i);
-    }
-	
-	// resolve the contacts in the contact graph
-    for(count = 0; sys->contact_detect(count, false) && count < MAX_CONTACTS; count++){
-		// update the contact graph using the new velocities
-		create_contact_graph(prev_pos, prev_vel, false);
-    }
-
-	// update the contact graph using the new velocities
-	create_contact_graph(prev_pos, prev_vel, false);
 
-	if(count == MAX_CONTACTS){
-		// shock propagation
-		for(;sys->contact_detect(count, true) && count < MAX_SHOCK_PROP; count++){
-			// update the contact graph using the new velocities
-			create_contact_graph(prev_pos, prev_vel, false);
-		}
-	}
-
-    // update position
-    for(int i = 0; i < sys->num_bodies(); ++i){
-        integrator->integrate_pos( *sys, dt, i );
+    int cur_time = glutGet(GLUT_ELAPSED_TIME);
+    int steps = timestep->advance((cur_time - prev_tick_time) / 1000.0);
+    prev_tick_time = cur_time;
+    for(int s = 0; s < steps; ++s){
+        save_last_pose();
+        step_simulation();
     }
 
     // calculate fps and reset system is necessary
@@ -544,8 +470,19 @@ static void idle_func ( int value )
         frame_number = 0;
     }
 
-	// update the data we are sending to clients
+	// update the data we are sending to clients, part of the way from the
+	// last pose to the current one as far as the wall clock is between the steps
     sys->saveOutputData(bodyInfoList);
+    double alpha = timestep->alpha();
+    for(int i = 0; i < sys->num_bodies(); ++i){
+        Body *b = bVector[i];
+        if(b->asleep)
+            continue;
+        BodyInfo &info = bodyInfoList[b->id];
+        const BodyInfo &last = last_pose[b->id];
+        info.Pos = last.Pos + alpha*(b->Position - last.Pos);
+        info.Orientation = slerp(last.Orientation, b->Orientation, alpha);
+    }
 
     frame_number++;
 
@@ -645,19 +582,25 @@ int main ( int argc, char ** argv )
 {
     glutInit ( &argc, argv );
 
-    integrator = new EulerRBIntegrator();
-
     if (argc < 2) {
-        fprintf(stderr, "usage: %s <port> [loop time]\n", argv[0]);
+        fprintf(stderr, "usage: %s <port> [loop time] [integrator]\n", argv[0]);
         exit(0);
     }
     port = atoi(argv[1]);
 
-    if(argc == 3)
+    if(argc >= 3)
         reset_time = 1000*atoi(argv[2]);
     else
         reset_time = -1;
 
+    if(argc >= 4){
+        integrator_type = rb_integrator_from_name(argv[3]);
+        if(integrator_type == NUM_RB_INTEGRATOR_TYPES){
+            fprintf(stderr, "unknown integrator %s\n", argv[3]);
+            exit(1);
+        }
+    }
+
     dt = 0.005f;
     dsim = 0;
     dump_frames = 0;
@@ -674,8 +617,10 @@ int main ( int argc, char ** argv )
         exit(1);
     }
 
+    timestep = new FixedTimestep(dt, MAX_SUBSTEPS);
     start_time = glutGet(GLUT_ELAPSED_TIME);
     prev_time = start_time;
+    prev_tick_time = start_time;
 
     // create thread to listen for incoming connections
     pthread_t tid;
@@ -9,16 +9,17 @@
 #include "csapp.h"
 #include "fps.h"
 
+#include <algorithm>
 #include <vector>
 #include <stdlib.h>
 #include <stdio.h>
 #include <GLUT/glut.h>
 
 /* macros */
-#define MAX_COLLISIONS 5
-#define MAX_CONTACTS 100
 #define rot_ang PI/6.0
 #define MAX_LEN 100
+// the smallest scale a body is drawn with along each axis
+#define MIN_DRAW_SIZE 0.01
 
 /* global variables */
 static int dump_frames;
@@ -122,7 +123,10 @@ static void draw_bodies ( void )
         double angle;
         bVector[i].Orientation.to_axis_angle(&axis, &angle);
         glRotated(angle*180/PI, axis[0], axis[1], axis[2]);
-        glScaled(bVector[i].size[0], bVector[i].size[1], bVector[i].size[2]);
+        // every body is drawn as a box, and a plane has no height, so it is
+        // drawn as a thin slab rather than scaled flat
+        glScaled(std::max<double>(bVector[i].size[0], MIN_DRAW_SIZE), std::max<double>(bVector[i].size[1], MIN_DRAW_SIZE),
+                 std::max<double>(bVector[i].size[2], MIN_DRAW_SIZE));
 
         // set color
         float arr[4];
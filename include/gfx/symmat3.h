@@ -20,7 +20,7 @@ namespace gfx
 class SymMat3
 {
 private:
-    double elt[6];
+    Vec3::value_type elt[6];
 
     inline int index(int i, int j) const
     {
@@ -34,33 +34,33 @@ private:
 public:
     // Standard constructors
     //
-    SymMat3(double s=0.0) { *this = s; }
+    SymMat3(Vec3::value_type s=0.0) { *this = s; }
     SymMat3(const SymMat3& m) { *this = m; }
 
-    double& operator()(int i, int j)       { return elt[index(i,j)]; }
-    double  operator()(int i, int j) const { return elt[index(i,j)]; }
+    Vec3::value_type& operator()(int i, int j)       { return elt[index(i,j)]; }
+    Vec3::value_type  operator()(int i, int j) const { return elt[index(i,j)]; }
 
     static int size() { return 6; }
     static int dim() { return 3; }
     typedef Vec3 vector_type;
     typedef Mat3 inverse_type;
-    typedef double value_type;
+    typedef Vec3::value_type value_type; // follows real_t in Math.h
 
-    operator       double*()       { return elt; }
-    operator const double*()       { return elt; }
-    operator const double*() const { return elt; }
+    operator       Vec3::value_type*()       { return elt; }
+    operator const Vec3::value_type*()       { return elt; }
+    operator const Vec3::value_type*() const { return elt; }
 
     inline Vec3 row(int i) const;
     inline Vec3 col(int j) const;
     Mat3 fullmatrix() const;
     
     inline SymMat3& operator=(const SymMat3& m);
-    inline SymMat3& operator=(double s);
+    inline SymMat3& operator=(Vec3::value_type s);
 
     inline SymMat3& operator+=(const SymMat3& m);
     inline SymMat3& operator-=(const SymMat3& m);
-    inline SymMat3& operator*=(double s);
-    inline SymMat3& operator/=(double s);
+    inline SymMat3& operator*=(Vec3::value_type s);
+    inline SymMat3& operator/=(Vec3::value_type s);
 
     static SymMat3 I();
     static SymMat3 outer_product(const Vec3& v);
@@ -80,7 +80,7 @@ inline Vec3 SymMat3::col(int j) const
 inline SymMat3& SymMat3::operator=(const SymMat3& m)
 	{ for(int i=0; i<size(); i++) elt[i]=m.elt[i]; return *this; }
 
-inline SymMat3& SymMat3::operator=(double s)
+inline SymMat3& SymMat3::operator=(Vec3::value_type s)
 	{ for(int i=0; i<size(); i++) elt[i]=s; return *this; }
 
 inline SymMat3& SymMat3::operator+=(const SymMat3& m)
@@ -89,10 +89,10 @@ inline SymMat3& SymMat3::operator+=(const SymMat3& m)
 inline SymMat3& SymMat3::operator-=(const SymMat3& m)
 	{ for(int i=0; i<size(); i++) elt[i]-=m.elt[i]; return *this; }
 
-inline SymMat3& SymMat3::operator*=(double s)
+inline SymMat3& SymMat3::operator*=(Vec3::value_type s)
 	{ for(int i=0; i<size(); i++) elt[i]*=s; return *this; }
 
-inline SymMat3& SymMat3::operator/=(double s)
+inline SymMat3& SymMat3::operator/=(Vec3::value_type s)
 	{ for(int i=0; i<size(); i++) elt[i]/=s; return *this; }
 
 ////////////////////////////////////////////////////////////////////////
@@ -103,9 +103,9 @@ inline SymMat3& SymMat3::operator/=(double s)
 inline SymMat3 operator+(SymMat3 n, const SymMat3& m) { n += m; return n; }
 inline SymMat3 operator-(SymMat3 n, const SymMat3& m) { n -= m; return n; }
 
-inline SymMat3 operator*(double s, SymMat3 m) { m*=s; return m; }
-inline SymMat3 operator*(SymMat3 m, double s) { m*=s; return m; }
-inline SymMat3 operator/(SymMat3 m, double s) { m/=s; return m; }
+inline SymMat3 operator*(Vec3::value_type s, SymMat3 m) { m*=s; return m; }
+inline SymMat3 operator*(SymMat3 m, Vec3::value_type s) { m*=s; return m; }
+inline SymMat3 operator/(SymMat3 m, Vec3::value_type s) { m/=s; return m; }
 
 inline Vec3 operator*(const SymMat3& m, const Vec3& v)
 	{ return Vec3(m.row(0)*v, m.row(1)*v, m.row(2)*v); }
@@ -120,13 +120,13 @@ extern std::ostream &operator<<(std::ostream &out, const SymMat3& M);
 // Misc. function definitions
 //
 
-inline double det(const SymMat3& m) { return m.row(0) * (m.row(1)^m.row(2)); }
+inline Vec3::value_type det(const SymMat3& m) { return m.row(0) * (m.row(1)^m.row(2)); }
 
-inline double trace(const SymMat3& m) { return m(0,0) + m(1,1) + m(2,2); }
+inline Vec3::value_type trace(const SymMat3& m) { return m(0,0) + m(1,1) + m(2,2); }
 
 inline SymMat3 transpose(const SymMat3& m) { return m; }
 	
-extern double invert(Mat3& m_inv, const SymMat3& m);
+extern Vec3::value_type invert(Mat3& m_inv, const SymMat3& m);
 
 extern bool eigen(const SymMat3& m, Vec3& eig_vals, Vec3 eig_vecs[3]);
 
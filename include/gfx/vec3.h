@@ -175,7 +175,12 @@ template<class T> inline TVec2<T> proj(const TVec3<T>& v)
     return u;
 }
 
+// follows real_t in Math.h
+#ifdef REAL_FLOAT
+typedef TVec3<float> Vec3;
+#else
 typedef TVec3<double> Vec3;
+#endif
 typedef TVec3<float>  Vec3f;
 
 } // namespace gfx
@@ -6,13 +6,16 @@
  */
 
 #include "integrator.h"
+#include "RBSteps.h"
+#include <math.h>
+#include <string.h>
 
 /**
  * Uses the basic Euler integration method, x' = x + dx/dt * dt.
  * @param sys The system to integrate
  * @param dt The time step to integrate over
  */
-void EulerIntegrator::integrate_pos( IntegrableSystem& sys, double dt ) const
+void EulerIntegrator::integrate_pos( IntegrableSystem& sys, real_t dt ) const
 {
     int size = sys.size_pos();
 
@@ -41,7 +44,7 @@ void EulerIntegrator::integrate_pos( IntegrableSystem& sys, double dt ) const
  * @param sys The system to integrate
  * @param dt The time step to integrate over
  */
-void EulerIntegrator::integrate_vel( IntegrableSystem& sys, double dt ) const
+void EulerIntegrator::integrate_vel( IntegrableSystem& sys, real_t dt ) const
 {
     int size = sys.size_vel();
 
@@ -70,29 +73,30 @@ void EulerIntegrator::integrate_vel( IntegrableSystem& sys, double dt ) const
  * @param sys The system to integrate
  * @param dt The time step to integrate over
  */
-void EulerRBIntegrator::integrate_pos( IntegrableSystem& sys, double dt, int i ) const
+void EulerRBIntegrator::integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const
 {
     int size = sys.size_pos();
 	int body_size = size / sys.num_bodies();
 
-    if (size == 0)
+    if (size == 0 || sys.is_asleep(i))
         return;
-    state.resize( size );
-    deriv_state.resize( size );
+    // only the entries of body i are needed
+    state.resize( body_size );
+    deriv_state.resize( body_size );
 
     // get the current state
-    sys.get_state_pos( &state[0] + i*body_size, i );
+    sys.get_state_pos( &state[0], i );
 
     // compute the current derivative
-    sys.eval_deriv_pos( &deriv_state[0] + i*body_size, i );
+    sys.eval_deriv_pos( &deriv_state[0], i );
 
     // update the state
-    for(int ii = 0; ii < size; ++ii){
+    for(int ii = 0; ii < body_size; ++ii){
         state[ii] += deriv_state[ii]*dt;
     }
 
     // set the updated state
-    sys.set_state_pos( &state[0] + i*body_size, i );
+    sys.set_state_pos( &state[0], i );
 }
 
 /**
@@ -100,27 +104,172 @@ void EulerRBIntegrator::integrate_pos( IntegrableSystem& sys, double dt, int i )
  * @param sys The system to integrate
  * @param dt The time step to integrate over
  */
-void EulerRBIntegrator::integrate_vel( IntegrableSystem& sys, double dt, int i ) const
+void EulerRBIntegrator::integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const
 {
     int size = sys.size_vel();
 	int body_size = size / sys.num_bodies();
 
-    if (size == 0)
+    if (size == 0 || sys.is_asleep(i))
         return;
-    state.resize( size );
-    deriv_state.resize( size );
+    // only the entries of body i are needed
+    state.resize( body_size );
+    deriv_state.resize( body_size );
 
     // get the current state
-    sys.get_state_vel( &state[0] + i*body_size, i );
+    sys.get_state_vel( &state[0], i );
 
     // compute the current derivative
-    sys.eval_deriv_vel( &deriv_state[0] + i*body_size, i );
+    sys.eval_deriv_vel( &deriv_state[0], i );
 
     // update the state
-    for(int ii = 0; ii < size; ++ii){
+    for(int ii = 0; ii < body_size; ++ii){
         state[ii] += deriv_state[ii]*dt;
     }
 
     // set the updated state
-    sys.set_state_vel( &state[0] + i*body_size, i );
+    sys.set_state_vel( &state[0], i );
+}
+
+/**
+ * Recovers the angular velocity from an orientation and its derivative,
+ * dq/dt = 0.5 * (0, w) * q, so (0, w) = 2 * dq/dt * conjugate(q).
+ **/
+void rb_angular_velocity( const real_t q[4], const real_t q_dot[4], real_t w[3] )
+{
+    w[0] = 2.0*(-q_dot[0]*q[1] + q[0]*q_dot[1] - q_dot[2]*q[3] + q_dot[3]*q[2]);
+    w[1] = 2.0*(-q_dot[0]*q[2] + q[0]*q_dot[2] - q_dot[3]*q[1] + q_dot[1]*q[3]);
+    w[2] = 2.0*(-q_dot[0]*q[3] + q[0]*q_dot[3] - q_dot[1]*q[2] + q_dot[2]*q[1]);
+}
+
+/**
+ * Sets q to q0 turned by the angular velocity w for time dt, using the
+ * exponential map exp(0.5 * w * dt) * q0.
+ **/
+void rb_rotate( const real_t q0[4], const real_t w[3], real_t dt, real_t q[4] )
+{
+    real_t speed = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+    real_t half_angle = 0.5*speed*dt;
+    real_t r[4];
+    r[0] = cos(half_angle);
+    // sin(a)/speed tends to dt/2 as the speed goes to zero
+    real_t s = speed > 1e-12 ? sin(half_angle)/speed : 0.5*dt;
+    r[1] = s*w[0];
+    r[2] = s*w[1];
+    r[3] = s*w[2];
+
+    real_t p[4];
+    p[0] = r[0]*q0[0] - r[1]*q0[1] - r[2]*q0[2] - r[3]*q0[3];
+    p[1] = r[0]*q0[1] + r[1]*q0[0] + r[2]*q0[3] - r[3]*q0[2];
+    p[2] = r[0]*q0[2] + r[2]*q0[0] + r[3]*q0[1] - r[1]*q0[3];
+    p[3] = r[0]*q0[3] + r[3]*q0[0] + r[1]*q0[2] - r[2]*q0[1];
+
+    // r is a unit quaternion, this only removes rounding
+    real_t maginv = 1.0/sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2] + p[3]*p[3]);
+    for(int k = 0; k < 4; ++k)
+        q[k] = p[k]*maginv;
+}
+
+/**
+ * Moves the position state x0 along the derivative x_dot for time dt into x,
+ * turning the orientation with the exponential map. at is the state x_dot
+ * was evaluated at.
+ **/
+void rb_advance_pos( const real_t x0[RB_POS_SIZE], const real_t at[RB_POS_SIZE],
+                     const real_t x_dot[RB_POS_SIZE], real_t dt, real_t x[RB_POS_SIZE] )
+{
+    for(int k = 0; k < RB_ORIENT; ++k)
+        x[k] = x0[k] + x_dot[k]*dt;
+
+    real_t w[3];
+    rb_angular_velocity( at + RB_ORIENT, x_dot + RB_ORIENT, w );
+    rb_rotate( x0 + RB_ORIENT, w, dt, x + RB_ORIENT );
+}
+
+/**
+ * Maps the angular velocity w at the rotation exp(u) * q0 back to the rate of
+ * change of u, the inverse of the derivative of the exponential map, to
+ * third order: w - [u, w]/2 + [u, [u, w]]/12.
+ **/
+void rb_dexp_inv( const real_t u[3], const real_t w[3], real_t u_dot[3] )
+{
+    real_t uw[3], uuw[3];
+    uw[0] = u[1]*w[2] - u[2]*w[1];
+    uw[1] = u[2]*w[0] - u[0]*w[2];
+    uw[2] = u[0]*w[1] - u[1]*w[0];
+    uuw[0] = u[1]*uw[2] - u[2]*uw[1];
+    uuw[1] = u[2]*uw[0] - u[0]*uw[2];
+    uuw[2] = u[0]*uw[1] - u[1]*uw[0];
+    for(int k = 0; k < 3; ++k)
+        u_dot[k] = w[k] - 0.5*uw[k] + uuw[k]/12.0;
+}
+
+// the rigid body integrators make their per-body calls through the virtual
+// interface, the steps themselves are in RBSteps.h
+
+void SymplecticEulerRBIntegrator::integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const
+{
+    RBSteps<IntegrableSystem>::symplectic_euler_pos( sys, dt, i );
+}
+
+void SymplecticEulerRBIntegrator::integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const
+{
+    RBSteps<IntegrableSystem>::euler_vel( sys, dt, i );
+}
+
+void VerletRBIntegrator::integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const
+{
+    RBSteps<IntegrableSystem>::verlet_pos( sys, dt, i );
+}
+
+void VerletRBIntegrator::integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const
+{
+    // the half kicks at the end of one step and the start of the next are
+    // one full kick, and the forces do not change over a step
+    RBSteps<IntegrableSystem>::euler_vel( sys, dt, i );
+}
+
+void RK4RBIntegrator::integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const
+{
+    RBSteps<IntegrableSystem>::rk4_pos( sys, dt, i );
+}
+
+void RK4RBIntegrator::integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const
+{
+    RBSteps<IntegrableSystem>::euler_vel( sys, dt, i );
+}
+
+static const char* const rb_integrator_names[NUM_RB_INTEGRATOR_TYPES] = {
+    "euler", "symplectic", "verlet", "rk4"
+};
+
+RBIntegrator* make_rb_integrator( RBIntegratorType type )
+{
+    switch(type){
+    case RB_EULER:
+        return new FixedEulerRBIntegrator<RB_POS_SIZE, RB_VEL_SIZE>();
+    case RB_SYMPLECTIC_EULER:
+        return new SymplecticEulerRBIntegrator();
+    case RB_VERLET:
+        return new VerletRBIntegrator();
+    case RB_RK4:
+        return new RK4RBIntegrator();
+    default:
+        return NULL;
+    }
+}
+
+const char* rb_integrator_name( RBIntegratorType type )
+{
+    if(type < 0 || type >= NUM_RB_INTEGRATOR_TYPES)
+        return "unknown";
+    return rb_integrator_names[type];
+}
+
+RBIntegratorType rb_integrator_from_name( const char* name )
+{
+    for(int type = 0; type < NUM_RB_INTEGRATOR_TYPES; ++type){
+        if(strcmp(name, rb_integrator_names[type]) == 0)
+            return (RBIntegratorType) type;
+    }
+    return NUM_RB_INTEGRATOR_TYPES;
 }
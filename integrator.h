@@ -9,6 +9,27 @@
 #pragma once
 
 #include <vector>
+#include "Math.h"
+
+// Per-body state of a rigid body as seen by the rigid body integrators. The
+// position is x, y, z followed by the orientation quaternion w, x, y, z and
+// the velocity is the momentum followed by the angular momentum.
+#define RB_POS_SIZE 7
+#define RB_VEL_SIZE 6
+// offset of the orientation in the position state of a rigid body
+#define RB_ORIENT 3
+
+/**
+ * The rigid body integrators which can be picked at run time.
+ */
+enum RBIntegratorType
+{
+    RB_EULER,
+    RB_SYMPLECTIC_EULER,
+    RB_VERLET,
+    RB_RK4,
+    NUM_RB_INTEGRATOR_TYPES
+};
 
 /**
  * Interface for an ODE system that can be solved with an integrator.
@@ -40,7 +61,7 @@ public:
      *   state vector will be stored.
      * @param time[out] Where the current time will be stored.
      */
-    virtual void get_state_pos( double* arr) const = 0;
+    virtual void get_state_pos( real_t* arr) const = 0;
 
     /**
      * Sets the current state, overriding the given state.
@@ -48,7 +69,7 @@ public:
      *   vector to be set.
      * @param time[in] The time to be set.
      */
-    virtual void set_state_pos( const double* arr) = 0;
+    virtual void set_state_pos( const real_t* arr) = 0;
 
     /**
      * Compute the derivative of the current state at the current time,
@@ -56,7 +77,7 @@ public:
      * @param deriv_result[out] An array of at least this->size() in length.
      *   The computed derivative of the state vector is stored here.
      */
-    virtual void eval_deriv_pos( double* deriv_result ) = 0;
+    virtual void eval_deriv_pos( real_t* deriv_result ) = 0;
 
     /**
      * @return The number of elements in the state array.
@@ -70,7 +91,7 @@ public:
      *   state vector will be stored.
      * @param time[out] Where the current time will be stored.
      */
-    virtual void get_state_vel( double* arr) const = 0;
+    virtual void get_state_vel( real_t* arr) const = 0;
 
     /**
      * Sets the current state, overriding the given state.
@@ -78,7 +99,7 @@ public:
      *   vector to be set.
      * @param time[in] The time to be set.
      */
-    virtual void set_state_vel( const double* arr) = 0;
+    virtual void set_state_vel( const real_t* arr) = 0;
 
     /**
      * Compute the derivative of the current state at the current time,
@@ -86,7 +107,7 @@ public:
      * @param deriv_result[out] An array of at least this->size() in length.
      *   The computed derivative of the state vector is stored here.
      */
-    virtual void eval_deriv_vel( double* deriv_result ) = 0;
+    virtual void eval_deriv_vel( real_t* deriv_result ) = 0;
 
 
 	/****************************
@@ -99,7 +120,7 @@ public:
      *   state vector will be stored.
      * @param time[out] Where the current time will be stored.
      */
-    virtual void get_state_pos( double *arr, int i) const = 0;
+    virtual void get_state_pos( real_t *arr, int i) const = 0;
 
     /**
      * Sets the current state, overriding the given state.
@@ -107,7 +128,7 @@ public:
      *   vector to be set.
      * @param time[in] The time to be set.
      */
-    virtual void set_state_pos( const double *arr, int i) = 0;
+    virtual void set_state_pos( const real_t *arr, int i) = 0;
 
     /**
      * Compute the derivative of the current state at the current time,
@@ -115,7 +136,7 @@ public:
      * @param deriv_result[out] An array of at least this->size() in length.
      *   The computed derivative of the state vector is stored here.
      */
-    virtual void eval_deriv_pos( double *deriv_result, int i) = 0;
+    virtual void eval_deriv_pos( real_t *deriv_result, int i) = 0;
 
     /**
      * Queries the current state.
@@ -123,7 +144,7 @@ public:
      *   state vector will be stored.
      * @param time[out] Where the current time will be stored.
      */
-    virtual void get_state_vel( double *arr, int i) const = 0;
+    virtual void get_state_vel( real_t *arr, int i) const = 0;
 
     /**
      * Sets the current state, overriding the given state.
@@ -131,7 +152,7 @@ public:
      *   vector to be set.
      * @param time[in] The time to be set.
      */
-    virtual void set_state_vel( const double *arr, int i) = 0;
+    virtual void set_state_vel( const real_t *arr, int i) = 0;
 
     /**
      * Compute the derivative of the current state at the current time,
@@ -139,13 +160,68 @@ public:
      * @param deriv_result[out] An array of at least this->size() in length.
      *   The computed derivative of the state vector is stored here.
      */
-    virtual void eval_deriv_vel( double *deriv_result, int i ) = 0;
+    virtual void eval_deriv_vel( real_t *deriv_result, int i ) = 0;
+
+	/**
+     * @return True if the ith object is asleep. Sleeping objects keep
+     *   their state and are skipped by the integrators.
+     */
+	virtual bool is_asleep( int i ) const { return false; }
 
 	/**
      * @return The number of actual objects in the system.
      *   This should be constant.
      */
 	virtual unsigned int num_bodies() const = 0;
+
+    /**
+     * The per-body calls under the names of the static system interface, see
+     * StaticIntegrableSystem, so the steps in RBSteps.h also run on systems
+     * only known through this interface. These make the virtual calls.
+     */
+    void body_get_pos( real_t *arr, int i ) const { get_state_pos( arr, i ); }
+    void body_set_pos( const real_t *arr, int i ) { set_state_pos( arr, i ); }
+    void body_deriv_pos( real_t *deriv_result, int i ) { eval_deriv_pos( deriv_result, i ); }
+    void body_get_vel( real_t *arr, int i ) const { get_state_vel( arr, i ); }
+    void body_set_vel( const real_t *arr, int i ) { set_state_vel( arr, i ); }
+    void body_deriv_vel( real_t *deriv_result, int i ) { eval_deriv_vel( deriv_result, i ); }
+    bool body_asleep( int i ) const { return is_asleep( i ); }
+};
+
+/**
+ * Base of systems which give the integrators their per-body calls without
+ * going through virtual functions. Derived hides the body_* members of
+ * IntegrableSystem with non-virtual ones of its own, preferably inline, and
+ * the steps in RBSteps.h instantiated on Derived call those directly. This
+ * class implements the per-body virtual functions of IntegrableSystem on top
+ * of them, so the system still works with any RBIntegrator.
+ *
+ * Derived must declare every body_* member, otherwise the virtual function
+ * and the member of IntegrableSystem call each other forever.
+ */
+template <class Derived>
+class StaticIntegrableSystem : public IntegrableSystem
+{
+public:
+    virtual void get_state_pos( real_t *arr, int i ) const { derived().body_get_pos( arr, i ); }
+    virtual void set_state_pos( const real_t *arr, int i ) { derived().body_set_pos( arr, i ); }
+    virtual void eval_deriv_pos( real_t *deriv_result, int i ) { derived().body_deriv_pos( deriv_result, i ); }
+    virtual void get_state_vel( real_t *arr, int i ) const { derived().body_get_vel( arr, i ); }
+    virtual void set_state_vel( const real_t *arr, int i ) { derived().body_set_vel( arr, i ); }
+    virtual void eval_deriv_vel( real_t *deriv_result, int i ) { derived().body_deriv_vel( deriv_result, i ); }
+    virtual bool is_asleep( int i ) const { return derived().body_asleep( i ); }
+
+    // the whole state calls are left to Derived
+    using IntegrableSystem::get_state_pos;
+    using IntegrableSystem::set_state_pos;
+    using IntegrableSystem::eval_deriv_pos;
+    using IntegrableSystem::get_state_vel;
+    using IntegrableSystem::set_state_vel;
+    using IntegrableSystem::eval_deriv_vel;
+
+private:
+    Derived& derived() { return *static_cast<Derived*>(this); }
+    const Derived& derived() const { return *static_cast<const Derived*>(this); }
 };
 
 /**
@@ -163,12 +239,12 @@ public:
      *   from the system's current step.
      * @param dt The length of the time step to integrate.
      */
-    virtual void integrate_pos( IntegrableSystem& sys, double dt ) const = 0;
-    virtual void integrate_vel( IntegrableSystem& sys, double dt ) const = 0;
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt ) const = 0;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt ) const = 0;
 
     // used for storing state vectors locally
     // without allocating memory every time.
-    typedef std::vector<double> StateList;
+    typedef std::vector<real_t> StateList;
 };
 
 /**
@@ -186,12 +262,14 @@ public:
      *   from the system's current step.
      * @param dt The length of the time step to integrate.
      */
-    virtual void integrate_pos( IntegrableSystem& sys, double dt, int i ) const = 0;
-    virtual void integrate_vel( IntegrableSystem& sys, double dt, int i ) const = 0;
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const = 0;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const = 0;
+
+    virtual RBIntegratorType type() const = 0;
 
     // used for storing state vectors locally
     // without allocating memory every time.
-    typedef std::vector<double> StateList;
+    typedef std::vector<real_t> StateList;
 };
 
 /**
@@ -202,8 +280,8 @@ class EulerIntegrator : public Integrator
 public:
     EulerIntegrator() { }
 	virtual ~EulerIntegrator() { state.clear(); deriv_state.clear();}
-    virtual void integrate_pos( IntegrableSystem& sys, double dt ) const;
-    virtual void integrate_vel( IntegrableSystem& sys, double dt ) const;
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt ) const;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt ) const;
 private:
     mutable StateList state;
     mutable StateList deriv_state;
@@ -218,9 +296,115 @@ class EulerRBIntegrator : public RBIntegrator
 public:
     EulerRBIntegrator() { }
 	virtual ~EulerRBIntegrator() { state.clear(); deriv_state.clear();}
-    virtual void integrate_pos( IntegrableSystem& sys, double dt, int i ) const;
-    virtual void integrate_vel( IntegrableSystem& sys, double dt, int i ) const;
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual RBIntegratorType type() const { return RB_EULER; }
 private:
     mutable StateList state;
     mutable StateList deriv_state;
 };
+
+/**
+ * Uses the basic Euler integration method, x' = x + dx/dt * dt.
+ * Integrates one body at a time for systems where every body has POS_SIZE
+ * position and VEL_SIZE velocity entries. The state of the body is kept on
+ * the stack, so a step costs the same however many bodies the system has.
+ */
+template <int POS_SIZE, int VEL_SIZE>
+class FixedEulerRBIntegrator : public RBIntegrator
+{
+public:
+    FixedEulerRBIntegrator() { }
+    virtual ~FixedEulerRBIntegrator() { }
+
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const
+    {
+        if (sys.is_asleep(i))
+            return;
+        real_t state[POS_SIZE];
+        real_t deriv_state[POS_SIZE];
+
+        sys.get_state_pos( state, i );
+        sys.eval_deriv_pos( deriv_state, i );
+        for(int ii = 0; ii < POS_SIZE; ++ii){
+            state[ii] += deriv_state[ii]*dt;
+        }
+        sys.set_state_pos( state, i );
+    }
+
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const
+    {
+        if (sys.is_asleep(i))
+            return;
+        real_t state[VEL_SIZE];
+        real_t deriv_state[VEL_SIZE];
+
+        sys.get_state_vel( state, i );
+        sys.eval_deriv_vel( deriv_state, i );
+        for(int ii = 0; ii < VEL_SIZE; ++ii){
+            state[ii] += deriv_state[ii]*dt;
+        }
+        sys.set_state_vel( state, i );
+    }
+
+    virtual RBIntegratorType type() const { return RB_EULER; }
+};
+
+/**
+ * Semi-implicit Euler. The frames step the momenta before the positions, so
+ * the positions already move with the new velocities. The orientation is
+ * turned by the exponential map of the angular velocity, which keeps it a
+ * rotation however large the step.
+ */
+class SymplecticEulerRBIntegrator : public RBIntegrator
+{
+public:
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual RBIntegratorType type() const { return RB_SYMPLECTIC_EULER; }
+};
+
+/**
+ * Velocity Verlet. The frames step the momenta before the positions, so
+ * the half kicks at either end of a step join up into the full kick of
+ * integrate_vel and the positions move with the velocity of the middle of
+ * the step, which is leapfrog. The angular velocity also depends on the
+ * orientation, so the turn uses the angular velocity at the orientation
+ * half way through it, which makes the rotation second order as well.
+ */
+class VerletRBIntegrator : public RBIntegrator
+{
+public:
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual RBIntegratorType type() const { return RB_VERLET; }
+};
+
+/**
+ * Fourth order Runge-Kutta on the positions. The angular velocity of a body
+ * changes with its orientation even when its angular momentum does not, so
+ * each stage sets the trial pose and derives the angular velocity again.
+ * The orientation is integrated as a rotation vector which turns the start
+ * orientation through the exponential map (Runge-Kutta-Munthe-Kaas). The
+ * forces are constant over a step, so the momenta are stepped with Euler.
+ */
+class RK4RBIntegrator : public RBIntegrator
+{
+public:
+    virtual void integrate_pos( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual void integrate_vel( IntegrableSystem& sys, real_t dt, int i ) const;
+    virtual RBIntegratorType type() const { return RB_RK4; }
+};
+
+/**
+ * Makes a rigid body integrator for systems with the RB_POS_SIZE and
+ * RB_VEL_SIZE layout.
+ */
+RBIntegrator* make_rb_integrator( RBIntegratorType type );
+
+const char* rb_integrator_name( RBIntegratorType type );
+
+/**
+ * @return The integrator called name, NUM_RB_INTEGRATOR_TYPES if there is none.
+ */
+RBIntegratorType rb_integrator_from_name( const char* name );
@@ -8,6 +8,7 @@
 
 #include "matrix.h"
 #include "quaternion.h"
+#include "simd3.h"
 
 #include <cstring>
 
@@ -22,14 +23,14 @@ const Matrix3 Matrix3::Zero = Matrix3( 0, 0, 0,
                                        0, 0, 0 );
 
 
-Matrix3::Matrix3( double r[SIZE] )
+Matrix3::Matrix3( real_t r[SIZE] )
 {
     memcpy( m, r, sizeof r );
 }
 
-Matrix3::Matrix3( double m00, double m10, double m20,
-                  double m01, double m11, double m21,
-                  double m02, double m12, double m22 )
+Matrix3::Matrix3( real_t m00, real_t m10, real_t m20,
+                  real_t m01, real_t m11, real_t m21,
+                  real_t m02, real_t m12, real_t m22 )
 {
     _m[0][0] = m00;
     _m[1][0] = m10;
@@ -83,16 +84,29 @@ Matrix3& Matrix3::operator-=( const Matrix3& rhs )
 Matrix3 Matrix3::operator*( const Matrix3& rhs ) const
 {
     Matrix3 product;
+#ifdef SIMD3
+    // each column of the product is this matrix times that column of rhs
+    v3real c0 = v3load( m );
+    v3real c1 = v3load( m + 3 );
+    v3real c2 = v3load( m + 6 );
+    for ( int i = 0; i < DIM; ++i )
+        v3store( product._m[i],
+                 v3add( v3add( v3mul( c0, v3set1( rhs._m[i][0] ) ),
+                               v3mul( c1, v3set1( rhs._m[i][1] ) ) ),
+                        v3mul( c2, v3set1( rhs._m[i][2] ) ) ) );
+#else
     for ( int i = 0; i < DIM; ++i )
         for ( int j = 0; j < DIM; ++j )
             product._m[i][j] =
                 _m[0][j] * rhs._m[i][0] + _m[1][j] * rhs._m[i][1] +
                 _m[2][j] * rhs._m[i][2];
+#endif
     return product;
 }
 
 Vec3 Matrix3::operator*( const Vec3& v ) const
 {
+    // kept scalar, the compiler does as well with it on its own
     return Vec3( _m[0][0]*v[0] + _m[1][0]*v[1] + _m[2][0]*v[2],
                     _m[0][1]*v[0] + _m[1][1]*v[1] + _m[2][1]*v[2],
                     _m[0][2]*v[0] + _m[1][2]*v[1] + _m[2][2]*v[2] );
@@ -103,7 +117,7 @@ Matrix3& Matrix3::operator*=( const Matrix3& rhs )
     return *this = operator*( rhs );
 }
 
-Matrix3 Matrix3::operator*( double r ) const
+Matrix3 Matrix3::operator*( real_t r ) const
 {
     Matrix3 rv;
     for ( int i = 0; i < SIZE; i++ )
@@ -111,25 +125,25 @@ Matrix3 Matrix3::operator*( double r ) const
     return rv;
 }
 
-Matrix3& Matrix3::operator*=( double r )
+Matrix3& Matrix3::operator*=( real_t r )
 {
     for ( int i = 0; i < SIZE; i++ )
         m[i] *= r;
     return *this;
 }
 
-Matrix3 Matrix3::operator/( double r ) const
+Matrix3 Matrix3::operator/( real_t r ) const
 {
     Matrix3 rv;
-    double inv = 1 / r;
+    real_t inv = 1 / r;
     for ( int i = 0; i < SIZE; i++ )
         rv.m[i] = m[i] * inv;
     return rv;
 }
 
-Matrix3& Matrix3::operator/=( double r )
+Matrix3& Matrix3::operator/=( real_t r )
 {
-    double inv = 1 / r;
+    real_t inv = 1 / r;
     for ( int i = 0; i < SIZE; i++ )
         m[i] *= inv;
     return *this;
@@ -168,6 +182,25 @@ void transpose( Matrix3* rv, const Matrix3& m )
 
 void inverse( Matrix3* rv, const Matrix3& m )
 {
+#ifdef SIMD3
+    // the columns of the adjugate are the cross products of the rows
+    v3real r0 = v3set( m._m[0][0], m._m[1][0], m._m[2][0] );
+    v3real r1 = v3set( m._m[0][1], m._m[1][1], m._m[2][1] );
+    v3real r2 = v3set( m._m[0][2], m._m[1][2], m._m[2][2] );
+    v3real c0 = v3cross( r1, r2 );
+    v3real c1 = v3cross( r2, r0 );
+    v3real c2 = v3cross( r0, r1 );
+
+    real_t det = m._m[0][0] * v3x( c0 ) +
+                 m._m[0][1] * v3x( c1 ) +
+                 m._m[0][2] * v3x( c2 );
+
+    real_t invdet = 1.0 / det;
+    v3real scale = v3set1( invdet );
+    v3store( rv->_m[0], v3mul( c0, scale ) );
+    v3store( rv->_m[1], v3mul( c1, scale ) );
+    v3store( rv->_m[2], v3mul( c2, scale ) );
+#else
     rv->_m[0][0] = m._m[1][1] * m._m[2][2] - m._m[1][2] * m._m[2][1];
     rv->_m[0][1] = m._m[0][2] * m._m[2][1] - m._m[0][1] * m._m[2][2];
     rv->_m[0][2] = m._m[0][1] * m._m[1][2] - m._m[0][2] * m._m[1][1];
@@ -178,13 +211,57 @@ void inverse( Matrix3* rv, const Matrix3& m )
     rv->_m[2][1] = m._m[0][1] * m._m[2][0] - m._m[0][0] * m._m[2][1];
     rv->_m[2][2] = m._m[0][0] * m._m[1][1] - m._m[0][1] * m._m[1][0];
 
-    double det = m._m[0][0] * rv->_m[0][0] +
+    real_t det = m._m[0][0] * rv->_m[0][0] +
                  m._m[0][1] * rv->_m[1][0] +
                  m._m[0][2] * rv->_m[2][0];
 
-    double invdet = 1.0 / det;
+    real_t invdet = 1.0 / det;
     for ( int i = 0; i < Matrix3::SIZE; i++ )
         rv->m[i] *= invdet;
+#endif
+}
+
+void inverse( SymMat3* rv, const SymMat3& m )
+{
+    // the adjugate of a symmetric matrix is symmetric too
+    real_t a = m( 0, 0 ), b = m( 1, 1 ), c = m( 2, 2 );
+    real_t d = m( 0, 1 ), e = m( 0, 2 ), f = m( 1, 2 );
+    real_t adj00 = b * c - f * f;
+    real_t adj01 = e * f - c * d;
+    real_t adj02 = d * f - b * e;
+
+    real_t det = a * adj00 + d * adj01 + e * adj02;
+
+    real_t invdet = 1.0 / det;
+    SymMat3& inv = *rv;
+    inv( 0, 0 ) = adj00 * invdet;
+    inv( 0, 1 ) = adj01 * invdet;
+    inv( 0, 2 ) = adj02 * invdet;
+    inv( 1, 1 ) = ( a * c - e * e ) * invdet;
+    inv( 1, 2 ) = ( d * e - a * f ) * invdet;
+    inv( 2, 2 ) = ( a * b - d * d ) * invdet;
+}
+
+SymMat3 star_congruence( const Matrix3& A, const Vec3& r )
+{
+    real_t a = A._m[0][0], b = A._m[1][1], c = A._m[2][2];
+    real_t d = A._m[1][0], e = A._m[2][0], f = A._m[2][1];
+    real_t x = r[0], y = r[1], z = r[2];
+
+    // A times the columns of r*, which are r x e_i: ( 0, z, -y ),
+    // ( -z, 0, x ) and ( y, -x, 0 ), leaving out what meets their zeros
+    real_t w0y = b * z - f * y, w0z = f * z - c * y;
+    real_t w1x = e * x - a * z, w1y = f * x - d * z, w1z = c * x - e * z;
+    real_t w2x = a * y - d * x, w2y = d * y - b * x, w2z = e * y - f * x;
+
+    SymMat3 K;
+    K( 0, 0 ) = z * w0y - y * w0z;
+    K( 0, 1 ) = z * w1y - y * w1z;
+    K( 0, 2 ) = z * w2y - y * w2z;
+    K( 1, 1 ) = x * w1z - z * w1x;
+    K( 1, 2 ) = x * w2z - z * w2x;
+    K( 2, 2 ) = y * w2x - x * w2y;
+    return K;
 }
 
 const Matrix4 Matrix4::Identity = Matrix4( 1, 0, 0, 0,
@@ -197,15 +274,15 @@ const Matrix4 Matrix4::Zero = Matrix4( 0, 0, 0, 0,
                                        0, 0, 0, 0,
                                        0, 0, 0, 0 );
 
-Matrix4::Matrix4( double r[SIZE] )
+Matrix4::Matrix4( real_t r[SIZE] )
 {
     memcpy( m , r, sizeof r );
 }
 
-Matrix4::Matrix4( double m00, double m10, double m20, double m30,
-                  double m01, double m11, double m21, double m31,
-                  double m02, double m12, double m22, double m32,
-                  double m03, double m13, double m23, double m33 )
+Matrix4::Matrix4( real_t m00, real_t m10, real_t m20, real_t m30,
+                  real_t m01, real_t m11, real_t m21, real_t m31,
+                  real_t m02, real_t m12, real_t m22, real_t m32,
+                  real_t m03, real_t m13, real_t m23, real_t m33 )
 {
     _m[0][0] = m00;
     _m[1][0] = m10;
@@ -280,7 +357,7 @@ Matrix4& Matrix4::operator*=( const Matrix4& rhs )
     return *this = operator*( rhs );
 }
 
-Matrix4 Matrix4::operator*( double r ) const
+Matrix4 Matrix4::operator*( real_t r ) const
 {
     Matrix4 rv;
     for ( int i = 0; i < SIZE; i++ )
@@ -288,25 +365,25 @@ Matrix4 Matrix4::operator*( double r ) const
     return rv;
 }
 
-Matrix4& Matrix4::operator*=( double r )
+Matrix4& Matrix4::operator*=( real_t r )
 {
     for ( int i = 0; i < SIZE; i++ )
         m[i] *= r;
     return *this;
 }
 
-Matrix4 Matrix4::operator/( double r ) const
+Matrix4 Matrix4::operator/( real_t r ) const
 {
     Matrix4 rv;
-    double inv = 1 / r;
+    real_t inv = 1 / r;
     for ( int i = 0; i < SIZE; i++ )
         rv.m[i] = m[i] * inv;
     return rv;
 }
 
-Matrix4& Matrix4::operator/=( double r )
+Matrix4& Matrix4::operator/=( real_t r )
 {
-    double inv = 1 / r;
+    real_t inv = 1 / r;
     for ( int i = 0; i < SIZE; i++ )
         m[i] *= inv;
     return *this;
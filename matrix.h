@@ -11,6 +11,7 @@
 
 #include "Math.h"
 #include "gfx/vec4.h"
+#include "gfx/symmat3.h"
 #include <cassert>
 
 namespace gfx {
@@ -132,6 +133,17 @@ void transpose( Matrix3* rv, const Matrix3& m );
 // computes the inverse of a matrix
 void inverse( Matrix3* rv, const Matrix3& m );
 
+// computes the inverse of a symmetric matrix
+void inverse( SymMat3* rv, const SymMat3& m );
+
+/**
+ * Computes r*^T A r* for a symmetric A, where r* is the matrix of the cross
+ * product with r, r* v = r x v. Only the diagonal and lower triangle of A
+ * are read, and the result is symmetric, so only its six distinct entries
+ * are worked out.
+ */
+SymMat3 star_congruence( const Matrix3& A, const Vec3& r );
+
 inline Matrix3 operator*( real_t r, const Matrix3& m ) {
     return m * r;
 }
@@ -9,6 +9,7 @@
 #include "quaternion.h"
 
 #include "matrix.h"
+#include "simd3.h"
 
 namespace gfx {
 
@@ -18,19 +19,19 @@ const Quaternion Quaternion::Identity( 1.0, 0.0, 0.0, 0.0 );
 
 static void make_unit( Quaternion& q )
 {
-    double maginv = 1.0 / sqrt( norm( q ) );
+    real_t maginv = 1.0 / sqrt( norm( q ) );
     q.x *= maginv;
     q.y *= maginv;
     q.z *= maginv;
     q.w *= maginv;
 }
 
-Quaternion::Quaternion( const Vec3& axis, double radians )
+Quaternion::Quaternion( const Vec3& axis, real_t radians )
 {
     radians *= 0.5;
     Vec3 naxis = axis;
     unitize( naxis );
-    double sine = sin( radians );
+    real_t sine = sin( radians );
 
     w = cos( radians );
     x = sine * naxis[0];
@@ -45,8 +46,8 @@ Quaternion::Quaternion( const Matrix3& mat )
     // Algorithm in Ken Shoemake's article in 1987 SIGGRAPH course notes
     // article "Quaternion Calculus and Fast Animation".
 
-    double trace = mat._m[0][0] + mat._m[1][1] + mat._m[2][2];
-    double root;
+    real_t trace = mat._m[0][0] + mat._m[1][1] + mat._m[2][2];
+    real_t root;
 
     if ( trace > 0.0 ) {
         root = sqrt( trace + 1.0 );  // 2w
@@ -57,19 +58,19 @@ Quaternion::Quaternion( const Matrix3& mat )
         z = ( mat._m[0][1] - mat._m[1][0] ) * root;
     } else {
         if ( mat._m[0][0] > mat._m[1][1] && mat._m[0][0] > mat._m[2][2] ) {
-            double s = 2.0 * sqrt( 1.0 + mat._m[0][0] - mat._m[1][1] - mat._m[2][2]);
+            real_t s = 2.0 * sqrt( 1.0 + mat._m[0][0] - mat._m[1][1] - mat._m[2][2]);
             x = 0.25 * s;
             w = (mat._m[1][2] - mat._m[2][1] ) / s;
             y = (mat._m[1][0] + mat._m[0][1] ) / s;
             z = (mat._m[2][0] + mat._m[0][2] ) / s;
         } else if (mat._m[1][1] > mat._m[2][2]) {
-            double s = 2.0 * sqrt( 1.0 + mat._m[1][1] - mat._m[0][0] - mat._m[2][2]);
+            real_t s = 2.0 * sqrt( 1.0 + mat._m[1][1] - mat._m[0][0] - mat._m[2][2]);
             y = 0.25 * s;
             w = (mat._m[2][0] - mat._m[0][2] ) / s;
             x = (mat._m[1][0] + mat._m[0][1] ) / s;
             z = (mat._m[2][1] + mat._m[1][2] ) / s;
         } else {
-            double s = 2.0 * sqrt( 1.0 + mat._m[2][2] - mat._m[0][0] - mat._m[1][1] );
+            real_t s = 2.0 * sqrt( 1.0 + mat._m[2][2] - mat._m[0][0] - mat._m[1][1] );
             z = 0.25 * s;
             w = (mat._m[0][1] - mat._m[1][0] ) / s;
             x = (mat._m[2][0] + mat._m[0][2] ) / s;
@@ -83,8 +84,8 @@ Quaternion::Quaternion( const Matrix4& mat )
     // Algorithm in Ken Shoemake's article in 1987 SIGGRAPH course notes
     // article "Quaternion Calculus and Fast Animation".
 
-    double trace = mat._m[0][0] + mat._m[1][1] + mat._m[2][2];
-    double root;
+    real_t trace = mat._m[0][0] + mat._m[1][1] + mat._m[2][2];
+    real_t root;
 
     if ( trace > 0.0 ) {
         // |w| > 1/2, may as well choose w > 1/2
@@ -127,6 +128,18 @@ Quaternion Quaternion::operator*( const Quaternion& rhs ) const
 Vec3 Quaternion::operator*( const Vec3& v ) const
 {
     // nVidia SDK implementation
+#ifdef SIMD3
+    v3real qvec = v3set( x, y, z );
+    v3real vec = v3load( v );
+    v3real uv = v3cross( qvec, vec );
+    v3real uuv = v3cross( qvec, uv );
+    uv = v3mul( uv, v3set1( 2.0 * w ) );
+    uuv = v3mul( uuv, v3set1( 2.0 ) );
+
+    Vec3 rv;
+    v3store( rv, v3add( v3add( vec, uv ), uuv ) );
+    return rv;
+#else
     Vec3 qvec( x, y, z );
     Vec3 uv = cross( qvec, v );
     Vec3 uuv = cross( qvec, uv );
@@ -134,16 +147,17 @@ Vec3 Quaternion::operator*( const Vec3& v ) const
     uuv *= 2.0;
 
     return v + uv + uuv;
+#endif
 }
 
-void Quaternion::to_axis_angle( Vec3* axis, double* angle ) const
+void Quaternion::to_axis_angle( Vec3* axis, real_t* angle ) const
 {
     // The quaternion representing the rotation is
     // q = cos(A/2)+sin(A/2)*(x*i+y*j+z*k)
-    double norm = x * x + y * y + z * z;
+    real_t norm = x * x + y * y + z * z;
     if ( norm > 0.0 ) {
         *angle = 2.0 * acos( w );
-        double inverse_length = 1 / sqrt( norm );
+        real_t inverse_length = 1 / sqrt( norm );
         (*axis)[0] = x * inverse_length;
         (*axis)[1] = y * inverse_length;
         (*axis)[2] = z * inverse_length;
@@ -155,20 +169,20 @@ void Quaternion::to_axis_angle( Vec3* axis, double* angle ) const
 }
 
 static void rotate_axes( const Quaternion& quat,
-                         double ax[3], double ay[3], double az[3] )
+                         real_t ax[3], real_t ay[3], real_t az[3] )
 {
-    double x2  = 2.0 * quat.x;
-    double y2  = 2.0 * quat.y;
-    double z2  = 2.0 * quat.z;
-    double xw2 = x2 * quat.w;
-    double yw2 = y2 * quat.w;
-    double zw2 = z2 * quat.w;
-    double xx2 = x2 * quat.x;
-    double xy2 = y2 * quat.x;
-    double xz2 = z2 * quat.x;
-    double yy2 = y2 * quat.y;
-    double yz2 = z2 * quat.y;
-    double zz2 = z2 * quat.z;
+    real_t x2  = 2.0 * quat.x;
+    real_t y2  = 2.0 * quat.y;
+    real_t z2  = 2.0 * quat.z;
+    real_t xw2 = x2 * quat.w;
+    real_t yw2 = y2 * quat.w;
+    real_t zw2 = z2 * quat.w;
+    real_t xx2 = x2 * quat.x;
+    real_t xy2 = y2 * quat.x;
+    real_t xz2 = z2 * quat.x;
+    real_t yy2 = y2 * quat.y;
+    real_t yz2 = z2 * quat.y;
+    real_t zz2 = z2 * quat.z;
 
     ax[0] = 1.0 - ( yy2 + zz2 );
     ax[1] = xy2 + zw2;
@@ -220,6 +234,17 @@ Quaternion conjugate( const Quaternion& q )
     return Quaternion( q.w, -q.x, -q.y, -q.z );
 }
 
+Quaternion slerp( const Quaternion& q0, const Quaternion& q1, real_t t )
+{
+    Quaternion rel = conjugate( q0 ) * q1;
+    if ( rel.w < 0.0 )
+        rel = rel * -1.0;
+    real_t s = sqrt( rel.x * rel.x + rel.y * rel.y + rel.z * rel.z );
+    if ( s <= 1e-6 )
+        return q0;
+    return q0 * Quaternion( Vec3( rel.x, rel.y, rel.z ) / s, t * 2.0 * atan2( s, rel.w ) );
+}
+
 std::ostream& operator <<( std::ostream& o, const Quaternion& q )
 {
     o << "Quaternion(" << q.w << ", " << q.x << ", " << q.y << ", " << q.z << ")";
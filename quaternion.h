@@ -9,7 +9,7 @@
 #ifndef _462_MATH_QUATERNION_HPP_
 #define _462_MATH_QUATERNION_HPP_
 
-#include "math.h"
+#include "Math.h"
 #include "gfx/vec3.h"
 
 namespace gfx {
@@ -51,7 +51,7 @@ public:
      */
     static const Quaternion Identity;
 
-    double w, x, y, z;
+    real_t w, x, y, z;
 
     /**
      * Default constructor. Leaves values uninitialized.
@@ -61,14 +61,14 @@ public:
     /**
      * Construct a quaternion with the given values.
      */
-    Quaternion( double w, double x, double y, double z )
+    Quaternion( real_t w, real_t x, real_t y, real_t z )
         : w( w ), x( x ), y( y ), z( z ) { }
 
     /**
      * Constructs a quaternion representing a rotation about the given axis
      * by the given angle.
      */
-    Quaternion( const Vec3& axis, double radians );
+    Quaternion( const Vec3& axis, real_t radians );
 
     /**
      *  Constructs a quaternion from a rotation matrix.
@@ -87,11 +87,11 @@ public:
      */
     Vec3 operator*( const Vec3& rhs ) const;
 
-    Quaternion operator*( double s ) const {
+    Quaternion operator*( real_t s ) const {
         return Quaternion( w * s, x * s, y * s, z * s );
     }
 
-    Quaternion& operator*=( double s ) {
+    Quaternion& operator*=( real_t s ) {
         w *= s;
         x *= s;
         y *= s;
@@ -112,7 +112,7 @@ public:
      * Convert this quaternion into an angle and axis.
      * Returns the rotation in radians about an axis.
      */
-    void to_axis_angle( Vec3* axis, double* angle ) const;
+    void to_axis_angle( Vec3* axis, real_t* angle ) const;
 
     /**
      * Converts this quaternion to a 3x3 matrix.
@@ -130,11 +130,11 @@ public:
     void to_axes( Vec3 axes[3] ) const;
 };
 
-inline double norm( const Quaternion& q ) {
+inline real_t norm( const Quaternion& q ) {
     return q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
 }
 
-inline Quaternion operator*( double s, const Quaternion& rhs ) {
+inline Quaternion operator*( real_t s, const Quaternion& rhs ) {
     return rhs * s;
 }
 
@@ -142,6 +142,12 @@ Quaternion normalize( const Quaternion& q );
 
 Quaternion conjugate( const Quaternion& q );
 
+/**
+ * Turns from q0 towards q1 at a constant rate along the shorter way round,
+ * t = 0 gives q0 and t = 1 gives q1.
+ */
+Quaternion slerp( const Quaternion& q0, const Quaternion& q1, real_t t );
+
 std::ostream& operator <<( std::ostream& o, const Quaternion& q );
 
 } /* _462 */
@@ -0,0 +1,97 @@
+/**
+ * @file simd3.h
+ * @brief Three component vector operations on SSE2 registers.
+ *
+ * @author Andrew Wesson (awesson)
+ */
+
+#pragma once
+
+#include "Math.h"
+
+/*
+The Matrix3 and Quaternion kernels are written once against these few
+operations on three reals, which map to SSE2 registers: one of four floats,
+or two of two doubles. SIMD3 is defined when the compiler targets SSE2, which
+every x86-64 compiler does, otherwise the kernels keep their scalar code.
+Building with -DNO_SIMD3 keeps the scalar code too, to compare against.
+
+There is no separate AVX version. A vector of three doubles fits one AVX
+register, but the cross products then have to move lanes across its two
+halves, which costs more than the second SSE2 register saves; bench math
+measured every kernel slower that way. Built with -mavx the SSE2 code below
+is encoded as AVX anyway.
+
+Every lane does the same multiplies and adds in the same order as the scalar
+code, so the results are the same bit for bit whichever is compiled in. The
+lanes past the third hold nothing in particular and are never stored.
+*/
+
+#if !defined(NO_SIMD3) && defined(REAL_FLOAT) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD3
+typedef __m128 v3real;
+static inline v3real v3load(const real_t *p)
+{
+    __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) p);
+    return _mm_movelh_ps(xy, _mm_load_ss(p + 2));
+}
+static inline void v3store(real_t *p, v3real a)
+{
+    _mm_storel_pi((__m64 *) p, a);
+    _mm_store_ss(p + 2, _mm_movehl_ps(a, a));
+}
+static inline v3real v3set(real_t x, real_t y, real_t z) { return _mm_setr_ps(x, y, z, 0); }
+static inline v3real v3set1(real_t a) { return _mm_set1_ps(a); }
+static inline v3real v3add(v3real a, v3real b) { return _mm_add_ps(a, b); }
+static inline v3real v3sub(v3real a, v3real b) { return _mm_sub_ps(a, b); }
+static inline v3real v3mul(v3real a, v3real b) { return _mm_mul_ps(a, b); }
+static inline real_t v3x(v3real a) { return _mm_cvtss_f32(a); }
+// (y, z, x)
+static inline v3real v3yzx(v3real a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)); }
+#elif !defined(NO_SIMD3) && !defined(REAL_FLOAT) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD3
+// x and y in one register, z in the low half of another
+struct v3real
+{
+    __m128d xy;
+    __m128d z;
+};
+static inline v3real v3make(__m128d xy, __m128d z)
+{
+    v3real r;
+    r.xy = xy;
+    r.z = z;
+    return r;
+}
+static inline v3real v3load(const real_t *p) { return v3make(_mm_loadu_pd(p), _mm_load_sd(p + 2)); }
+static inline void v3store(real_t *p, v3real a)
+{
+    _mm_storeu_pd(p, a.xy);
+    _mm_store_sd(p + 2, a.z);
+}
+static inline v3real v3set(real_t x, real_t y, real_t z) { return v3make(_mm_setr_pd(x, y), _mm_set_sd(z)); }
+static inline v3real v3set1(real_t a)
+{
+    __m128d r = _mm_set1_pd(a);
+    return v3make(r, r);
+}
+static inline v3real v3add(v3real a, v3real b) { return v3make(_mm_add_pd(a.xy, b.xy), _mm_add_sd(a.z, b.z)); }
+static inline v3real v3sub(v3real a, v3real b) { return v3make(_mm_sub_pd(a.xy, b.xy), _mm_sub_sd(a.z, b.z)); }
+static inline v3real v3mul(v3real a, v3real b) { return v3make(_mm_mul_pd(a.xy, b.xy), _mm_mul_sd(a.z, b.z)); }
+static inline real_t v3x(v3real a) { return _mm_cvtsd_f64(a.xy); }
+static inline v3real v3yzx(v3real a) { return v3make(_mm_shuffle_pd(a.xy, a.z, 1), a.xy); }
+#endif
+
+#ifdef SIMD3
+/**
+ * The cross product a x b. Lane i of t is a[i]*b[i+1] - a[i+1]*b[i], which
+ * is component i+2 of the product.
+ */
+static inline v3real v3cross(v3real a, v3real b)
+{
+    v3real t = v3sub(v3mul(a, v3yzx(b)), v3mul(v3yzx(a), b));
+    return v3yzx(t);
+}
+#endif